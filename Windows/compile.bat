@@ -1 +1 @@
-g++ ..\src\*.cpp -I..\src -I C:\msys64\mingw64\include\SDL2 -Wall -lmingw32 -lSDL2main -lSDL2_image -lSDL2_mixer -lSDL2_ttf -lSDL2 -o CHIP8
+g++ ..\src\audio.cpp ..\src\binio.cpp ..\src\chip8.cpp ..\src\clock.cpp ..\src\cpu.cpp ..\src\dir_nav.cpp ..\src\display.cpp ..\src\headless.cpp ..\src\input.cpp ..\src\jit.cpp ..\src\main.cpp ..\src\profiler.cpp ..\src\replay.cpp ..\src\rewind.cpp ..\src\savestate.cpp ..\src\scheduler.cpp ..\src\seek.cpp ..\src\terminal.cpp ..\src\thread_pool.cpp ..\src\trace.cpp -I..\src -I C:\msys64\mingw64\include\SDL2 -Wall -lmingw32 -lSDL2main -lSDL2_image -lSDL2_mixer -lSDL2_ttf -lSDL2 -o CHIP8
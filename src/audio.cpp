@@ -0,0 +1,42 @@
+#include <audio.h>
+#include <cstdio>
+#include <cstring>
+
+bool Beeper::Open(uint16_t buffer_samples){
+	SDL_AudioSpec want = {}, have;
+	want.freq = AUDIO_FREQ;
+	want.format = AUDIO_S16SYS;
+	want.channels = 1;
+	want.samples = buffer_samples;
+	want.callback = Callback;
+	want.userdata = this;
+	// Any format change is converted by SDL, so the callback always gets what it asked for except the buffer size
+	device = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+	if (!device){
+		printf("No sound, couldn't open the audio device: %s\n", SDL_GetError());
+		return false;
+	}
+	half_period = have.freq / BEEP_HZ / 2;
+	SDL_PauseAudioDevice(device, 0);
+	return true;
+}
+
+void Beeper::Close(){
+	if (device)
+		SDL_CloseAudioDevice(device);
+	device = 0;
+}
+
+void Beeper::Callback(void* userdata, Uint8* stream, int len){
+	Beeper* beeper = (Beeper*) userdata;
+	int16_t* samples = (int16_t*) stream;
+	int count = len / sizeof(int16_t);
+	if (!beeper->beeping.load(std::memory_order_relaxed)){
+		// Next beep starts at the beginning of the wave
+		beeper->phase = 0;
+		memset(stream, 0, len);
+		return;
+	}
+	for (int s = 0; s < count; s++, beeper->phase++)
+		samples[s] = ((beeper->phase / beeper->half_period) & 1) ? -BEEP_VOLUME : BEEP_VOLUME;
+}
@@ -0,0 +1,40 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <SDL2/SDL.h>
+#include <atomic>
+
+#define AUDIO_FREQ 44100
+// Samples per audio callback, about 12ms at AUDIO_FREQ
+#define DEFAULT_AUDIO_BUFFER 512
+// Pitch and loudness of the beep
+#define BEEP_HZ 440
+#define BEEP_VOLUME 3000
+
+/* Square wave beeper driven by the sound timer
+ * SDL calls Callback on its own audio thread whenever the device needs more samples. All it shares with the emulation
+ * is one atomic flag, so the emulation never waits on the audio device (no SDL_LockAudioDevice) and the callback never
+ * waits on the emulation. The buffer size trades latency for safety: a smaller one starts and stops the beep sooner
+ * after st changes, but the callback runs more often and the sound crackles if it's ever late. */
+class Beeper {
+public:
+	~Beeper() { Close(); }
+
+	// Open the default audio device with buffer_samples per callback and start it. Returns false if there's no audio
+	// device, in which case the emulator simply runs without sound.
+	bool Open(uint16_t buffer_samples = DEFAULT_AUDIO_BUFFER);
+	void Close();
+	// Turn the tone on or off, from any thread
+	void Set(bool on) { beeping.store(on, std::memory_order_relaxed); }
+
+private:
+	SDL_AudioDeviceID device = 0;
+	std::atomic<bool> beeping{false};
+	// Only touched by the callback once the device is open
+	uint32_t phase = 0; // Samples into the current beep
+	uint32_t half_period = AUDIO_FREQ / BEEP_HZ / 2; // Samples between flips of the wave
+
+	static void Callback(void* userdata, Uint8* stream, int len);
+};
+
+#endif // AUDIO_H
@@ -0,0 +1,167 @@
+// chip8-batch: runs every ROM under a directory headless, spread across all cores, and reports on each of them
+#include <chip8.h>
+#include <cpu.h>
+#include <headless.h>
+#include <jit.h>
+#include <thread_pool.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+// For parsing CLI args
+#include <getopt.h>
+
+#define DEFAULT_FRAMES 6000
+// Every ROM's RNG starts from the same seed, so the framebuffer hashes come out the same on every run
+#define DEFAULT_SEED 1
+
+struct RomResult {
+	std::string path;
+	bool loaded = false;
+	size_t cycles = 0;
+	double seconds = 0;
+	size_t invalid_opcodes = 0;
+	uint64_t gfx_hash = 0;
+};
+
+void help_menu(){
+	printf("Usage: chip8-batch [options] <games_directory>\n"
+			"Options:\n"
+			"-f, --frames <n>\t\tFrames (1/60s of emulated time) to run each ROM for (default %d)\n"
+			"-i, --ips <n>\t\t\tEmulated instructions per second (default %d)\n"
+			"-t, --threads <n>\t\tWorker threads (default: one per core)\n"
+			"-j, --jit\t\t\tTranslate instructions to native code where possible (x86-64 only)\n"
+			"    --seed <n>\t\t\tSeed for the random number generator (default %d)\n"
+			"-h, --help\t\t\tThis help menu\n", DEFAULT_FRAMES, DEFAULT_IPS, DEFAULT_SEED);
+}
+
+void RunRom(RomResult* result, size_t num_frames, size_t ips, bool use_jit, uint32_t seed){
+	std::unique_ptr<Chip8> chip8(new Chip8);
+	if (chip8->LoadROM(result->path.c_str(), ROM_START, false) != ROM_OK)
+		return;
+	result->loaded = true;
+
+	std::unique_ptr<CPU> cpu(new CPU(chip8.get()));
+	cpu->seed(seed);
+	std::unique_ptr<Jit> jit;
+	if (use_jit){
+		jit.reset(new Jit);
+		if (jit->available())
+			cpu->jit = jit.get();
+	}
+	NullInput input;
+	NullOutput output;
+
+	auto start = std::chrono::steady_clock::now();
+	Clock clock;
+	Scheduler sched(cpu.get(), &clock, ips);
+	sched.uncapped = true;
+	result->cycles = RunHeadless(&sched, num_frames * ips / 60, &input, &output);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	result->seconds = elapsed.count();
+	result->invalid_opcodes = cpu->invalid_opcodes;
+	result->gfx_hash = chip8->HashGFX();
+}
+
+int main(int argc, char *argv[]){
+	size_t num_frames = DEFAULT_FRAMES;
+	size_t ips = DEFAULT_IPS;
+	size_t num_threads = 0;
+	bool use_jit = false;
+	uint32_t seed = DEFAULT_SEED;
+	int o;
+	int opt_index = 0;
+
+	const struct option long_opts[] =
+	{
+		{"frames", required_argument, 0, 'f'},
+		{"ips", required_argument, 0, 'i'},
+		{"threads", required_argument, 0, 't'},
+		{"jit", no_argument, 0, 'j'},
+		{"seed", required_argument, 0, 'e'},
+		{"help",   no_argument,  0, 'h'},
+		{0,0,0,0},
+	};
+
+	while ((o = getopt_long(argc, argv, "hjf:i:t:e:", long_opts, &opt_index)) != -1){
+		switch (o){
+			case 'f':
+				num_frames = std::strtoull(optarg, NULL, 0);
+				break;
+			case 'i':
+				ips = std::strtoull(optarg, NULL, 0);
+				// Frames of 0 instructions would never get anywhere
+				if (!ips){
+					printf("Invalid instructions per second \"%s\"\n", optarg);
+					help_menu();
+					exit(1);
+				}
+				break;
+			case 't':
+				num_threads = std::strtoull(optarg, NULL, 0);
+				break;
+			case 'j':
+				use_jit = true;
+				break;
+			case 'e':
+				seed = std::strtoul(optarg, NULL, 0);
+				break;
+			case 'h':
+				help_menu();
+				exit(0);
+				break;
+			default:
+				help_menu();
+				exit(1);
+				break;
+		}
+	}
+
+	if (optind >= argc){
+		help_menu();
+		exit(1);
+	}
+
+	std::vector<RomResult> results;
+	for (const auto& entry : std::filesystem::recursive_directory_iterator(argv[optind])){
+		// Hidden files aren't ROMs, the GUI's library index (LIBRARY_INDEX) lives in the ROM directory
+		if (!entry.is_regular_file() || entry.path().filename().string()[0] == '.')
+			continue;
+		RomResult result;
+		result.path = entry.path().string();
+		results.push_back(result);
+	}
+	std::sort(results.begin(), results.end(), [](const RomResult& a, const RomResult& b){ return a.path < b.path; });
+
+	auto start = std::chrono::steady_clock::now();
+	{
+		ThreadPool pool(num_threads);
+		fprintf(stderr, "Running %zu ROMs for %zu frames on %zu threads with seed %u\n", results.size(), num_frames,
+				pool.NumThreads(), seed);
+		for (RomResult& result : results)
+			pool.Submit([&result, num_frames, ips, use_jit, seed]{ RunRom(&result, num_frames, ips, use_jit, seed); });
+		pool.Wait();
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	int failed = 0;
+	size_t total_cycles = 0;
+	printf("rom,instructions,seconds,instructions_per_sec,invalid_opcodes,gfx_hash\n");
+	for (const RomResult& result : results){
+		if (!result.loaded){
+			fprintf(stderr, "Failed to load %s\n", result.path.c_str());
+			failed++;
+			continue;
+		}
+		total_cycles += result.cycles;
+		printf("\"%s\",%zu,%.6f,%.0f,%zu,%016llx\n", result.path.c_str(), result.cycles, result.seconds,
+				result.cycles / result.seconds, result.invalid_opcodes, (unsigned long long) result.gfx_hash);
+	}
+	fprintf(stderr, "Ran %zu instructions in %.3fs (%.0f instructions/sec across all threads)\n",
+			total_cycles, elapsed.count(), total_cycles / elapsed.count());
+	return failed ? 1 : 0;
+}
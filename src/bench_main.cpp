@@ -0,0 +1,332 @@
+// chip8-bench: microbenchmarks for the interpreter's hot paths plus whole-ROM runs, one JSON object per line
+#include <chip8.h>
+#include <cpu.h>
+#include <headless.h>
+#include <jit.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef BENCH_SDL
+#include <display.h>
+// display.cpp's ExitChip8 expects the frontend to own the window
+SDL_Window* window = NULL;
+#endif
+
+// For parsing CLI args
+#include <getopt.h>
+
+#define DEFAULT_OPS 2000000
+#define DEFAULT_CYCLES 1000000
+#define DEFAULT_REPEAT 5
+
+size_t repeat = DEFAULT_REPEAT;
+const char* filter = NULL;
+
+void help_menu(){
+	printf("Usage: chip8-bench [options] [games_directory]\n"
+			"Prints one JSON object per benchmark: {\"bench\", \"case\", \"ops\", \"seconds\", \"ns_per_op\", \"ops_per_sec\"}.\n"
+			"Each benchmark runs several times and the fastest run is reported.\n"
+			"Options:\n"
+			"-n, --ops <n>\t\t\tOperations per microbenchmark run (default %d)\n"
+			"-c, --cycles <n>\t\tInstructions per ROM run (default %d)\n"
+			"-r, --repeat <n>\t\tRuns per benchmark (default %d)\n"
+			"-f, --filter <text>\t\tOnly run benchmarks whose \"bench/case\" contains text\n"
+			"-h, --help\t\t\tThis help menu\n", DEFAULT_OPS, DEFAULT_CYCLES, DEFAULT_REPEAT);
+}
+
+// JSON string contents, ROM names are the only thing that can contain quotes or backslashes
+std::string JsonEscape(const std::string& str){
+	std::string out;
+	for (char c : str){
+		if (c == '"' || c == '\\')
+			out += '\\';
+		out += c;
+	}
+	return out;
+}
+
+// Times fn, which does ops operations per call, and prints the fastest of repeat runs.
+// setup runs before every call and isn't timed.
+template<typename Setup, typename Fn>
+void Bench(const char* bench, const std::string& name, size_t ops, Setup setup, Fn fn){
+	if (filter && (std::string(bench) + "/" + name).find(filter) == std::string::npos)
+		return;
+	double best = 0;
+	for (size_t r = 0; r < repeat; r++){
+		setup();
+		auto start = std::chrono::steady_clock::now();
+		fn();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		if (r == 0 || elapsed.count() < best)
+			best = elapsed.count();
+	}
+	printf("{\"bench\":\"%s\",\"case\":\"%s\",\"ops\":%zu,\"seconds\":%.9f,\"ns_per_op\":%.3f,\"ops_per_sec\":%.0f}\n",
+			bench, JsonEscape(name).c_str(), ops, best, best * 1e9 / ops, ops / best);
+	fflush(stdout);
+}
+
+// A Chip8 and CPU with a fixed seed and no input, so every run does exactly the same work
+struct Machine {
+	std::unique_ptr<Chip8> chip8;
+	std::unique_ptr<CPU> cpu;
+	NullInput input;
+
+	Machine() : chip8(new Chip8), cpu(new CPU(chip8.get())) {
+		cpu->seed(1);
+	}
+
+	// Put a program at 0x200, followed by a jump back to its start so it loops forever
+	void Load(const std::vector<uint16_t>& program){
+		uint16_t addr = 0x200;
+		for (uint16_t opcode : program){
+			chip8->mem[addr++] = opcode >> 8;
+			chip8->mem[addr++] = opcode & 0xFF;
+		}
+		chip8->mem[addr++] = 0x12;
+		chip8->mem[addr++] = 0x00;
+		cpu->flush_icache();
+	}
+
+	// Run through jit from now on. The Jit is shared between cases, whatever it compiled for the last program is dropped.
+	void UseJit(Jit* jit){
+		cpu->jit = jit;
+		cpu->flush_icache();
+	}
+};
+
+struct InstructionMix {
+	const char* name;
+	std::vector<uint16_t> program;
+};
+
+// Synthetic programs for CPU::cycle(), each one stresses a different group of handlers
+const InstructionMix mixes[] = {
+	// LD/ADD/OR/AND/XOR/SUB/SHR/SUBN/SHL
+	{"alu", {0x6012, 0x6134, 0x7003, 0x8014, 0x8121, 0x8232, 0x8303, 0x8415, 0x8516, 0x8617, 0x871E, 0x8010}},
+	// Skips that are taken and not taken, CALL/RET
+	{"branch", {0x6000, 0x6101, 0x3000, 0x0000, 0x4000, 0x3001, 0x5010, 0x9010, 0x0000, 0x2216, 0x1218, 0x00EE}},
+	// BCD, register dumps/loads and I arithmetic, all writing/reading above the program
+	{"memory", {0x6080, 0x6101, 0xA300, 0xF033, 0xF155, 0xF165, 0xF11E, 0xF029, 0xA400, 0xF755, 0xF765}},
+	// Timers and the RNG
+	{"timers", {0x60FF, 0x6405, 0xF015, 0xF107, 0xF018, 0xC2FF, 0xC30F, 0xE49E, 0xE4A1}},
+	// A bit of everything, roughly what games do between draws
+	{"mixed", {0x6005, 0x7101, 0x8014, 0x3100, 0x7201, 0xA300, 0xF033, 0xF265, 0xC0FF, 0x4000, 0x8126, 0xF007,
+		0xD015, 0x9010}},
+};
+
+void BenchCycle(size_t ops){
+	for (const InstructionMix& mix : mixes){
+		Machine m;
+		m.Load(mix.program);
+		Bench("cycle", mix.name, ops, []{}, [&]{
+			CPU* cpu = m.cpu.get();
+			for (size_t n = 0; n < ops; n++)
+				cpu->cycle();
+		});
+	}
+
+	// Same mixes through run() with the JIT, for comparison (only the alu mix really compiles)
+	Jit jit;
+	if (!jit.available())
+		return;
+	for (const InstructionMix& mix : mixes){
+		Machine m;
+		m.Load(mix.program);
+		m.UseJit(&jit);
+		Bench("cycle-jit", mix.name, ops, []{}, [&]{ m.cpu->run(ops); });
+	}
+}
+
+void BenchDraw(size_t ops){
+	struct Position {
+		const char* name;
+		uint8_t x;
+		uint8_t y;
+		bool clipped; // Whether the sprites drawn here run off the screen
+	};
+	// Byte aligned, straddling two bytes, and partly off the right/bottom edges
+	const Position positions[] = {{"aligned", 8, 4, false}, {"unaligned", 13, 7, false}, {"clipped", 60, 28, true}};
+	const uint8_t heights[] = {1, 5, 15};
+
+	Machine m;
+	m.cpu->i = 0x300;
+	for (int b = 0; b < 15; b++)
+		m.chip8->mem[0x300 + b] = 0xA5 ^ (b * 0x1F);
+	for (const Position& pos : positions){
+		for (uint8_t n : heights){
+			// draw() takes the registers holding the coordinates, like Dxyn
+			auto setup = [&]{
+				m.chip8->ClearScreen();
+				m.cpu->v[0] = pos.x;
+				m.cpu->v[1] = pos.y;
+			};
+
+			// Make sure the case measures what it's named after, clipped sprites lose some of their pixels
+			setup();
+			m.cpu->draw(0, 1, n);
+			int lit = 0, sprite_bits = 0;
+			for (int y = 0; y < HIRES_Y; y++)
+				for (int word = 0; word < GFX_WORDS; word++)
+					lit += __builtin_popcountll(m.chip8->gfx[y][word]);
+			for (int b = 0; b < n; b++)
+				sprite_bits += __builtin_popcount(m.chip8->mem[0x300 + b]);
+			if ((lit < sprite_bits) != pos.clipped){
+				fprintf(stderr, "drw/%s/%d: expected the sprite to be %s\n", pos.name, n, pos.clipped ? "clipped" : "whole");
+				exit(1);
+			}
+
+			std::string name = std::string(pos.name) + "/" + std::to_string(n);
+			Bench("drw", name, ops, setup, [&]{
+				CPU* cpu = m.cpu.get();
+				for (size_t k = 0; k < ops; k++)
+					cpu->draw(0, 1, n);
+			});
+		}
+	}
+}
+
+void BenchDecode(size_t ops){
+	Machine m;
+	// Every opcode in turn, so all of decode()'s branches are hit equally
+	size_t rounds = std::max<size_t>(ops / 0x10000, 1);
+	volatile uint8_t sink = 0;
+	Bench("decode", "all_opcodes", rounds * 0x10000, []{}, [&]{
+		CPU* cpu = m.cpu.get();
+		uint8_t acc = 0;
+		for (size_t r = 0; r < rounds; r++)
+			for (uint32_t opcode = 0; opcode <= 0xFFFF; opcode++)
+				acc += cpu->decode(opcode);
+		sink = acc;
+	});
+	(void) sink;
+}
+
+#ifdef BENCH_SDL
+void BenchRender(size_t ops){
+	// Software renderer on a surface the size of the window, no display needed
+	SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, SCREEN_X, SCREEN_Y, 32, SDL_PIXELFORMAT_ARGB8888);
+	SDL_Renderer* renderer = surface ? SDL_CreateSoftwareRenderer(surface) : NULL;
+	if (!renderer){
+		fprintf(stderr, "Skipping render benchmarks: %s\n", SDL_GetError());
+		if (surface)
+			SDL_FreeSurface(surface);
+		return;
+	}
+
+	Machine m;
+	for (int y = 0; y < DISP_Y; y++)
+		m.chip8->gfx[y][0] = 0xF0F0F0F0F0F0F0F0ULL >> (y % 8);
+	size_t frames = std::max<size_t>(ops / 1000, 1);
+	{
+		Display disp(m.chip8.get(), renderer);
+		// A frame that has to be uploaded and presented, then one where nothing was drawn
+		Bench("render", "changed", frames, []{}, [&]{
+			for (size_t f = 0; f < frames; f++){
+				m.chip8->draw_flag = true;
+				disp.RenderGFX();
+			}
+		});
+		Bench("render", "unchanged", ops, []{}, [&]{
+			for (size_t f = 0; f < ops; f++)
+				disp.RenderGFX();
+		});
+	}
+	SDL_DestroyRenderer(renderer);
+	SDL_FreeSurface(surface);
+}
+#endif
+
+void BenchRoms(const char* dir, size_t num_cycles){
+	std::vector<std::string> roms;
+	for (const auto& entry : std::filesystem::directory_iterator(dir))
+		// Skipping hidden files, like the GUI's library index
+		if (entry.is_regular_file() && entry.path().filename().string()[0] != '.')
+			roms.push_back(entry.path().string());
+	std::sort(roms.begin(), roms.end());
+
+	Jit jit;
+	for (const std::string& rom : roms){
+		for (bool use_jit : {false, true}){
+			if (use_jit && !jit.available())
+				continue;
+			std::unique_ptr<Machine> m;
+			Clock clock;
+			std::unique_ptr<Scheduler> sched;
+			NullOutput output;
+			bool loaded = true;
+			// Every run starts the ROM from scratch
+			auto setup = [&]{
+				m.reset(new Machine);
+				loaded = m->chip8->LoadROM(rom.c_str(), ROM_START, false) == ROM_OK;
+				if (use_jit)
+					m->UseJit(&jit);
+				sched.reset(new Scheduler(m->cpu.get(), &clock));
+				sched->uncapped = true;
+			};
+			std::string name = std::filesystem::path(rom).filename().string();
+			Bench(use_jit ? "rom-jit" : "rom", name, num_cycles, setup, [&]{
+				if (loaded)
+					RunHeadless(sched.get(), num_cycles, &m->input, &output);
+			});
+			if (!loaded)
+				fprintf(stderr, "Failed to load %s\n", rom.c_str());
+		}
+	}
+}
+
+int main(int argc, char *argv[]){
+	size_t ops = DEFAULT_OPS;
+	size_t num_cycles = DEFAULT_CYCLES;
+	int o;
+	int opt_index = 0;
+
+	const struct option long_opts[] =
+	{
+		{"ops", required_argument, 0, 'n'},
+		{"cycles", required_argument, 0, 'c'},
+		{"repeat", required_argument, 0, 'r'},
+		{"filter", required_argument, 0, 'f'},
+		{"help",   no_argument,  0, 'h'},
+		{0,0,0,0},
+	};
+
+	while ((o = getopt_long(argc, argv, "hn:c:r:f:", long_opts, &opt_index)) != -1){
+		switch (o){
+			case 'n':
+				ops = std::strtoull(optarg, NULL, 0);
+				break;
+			case 'c':
+				num_cycles = std::strtoull(optarg, NULL, 0);
+				break;
+			case 'r':
+				repeat = std::max<size_t>(std::strtoull(optarg, NULL, 0), 1);
+				break;
+			case 'f':
+				filter = optarg;
+				break;
+			case 'h':
+				help_menu();
+				exit(0);
+				break;
+			default:
+				help_menu();
+				exit(1);
+				break;
+		}
+	}
+
+	BenchCycle(ops);
+	BenchDraw(ops);
+	BenchDecode(ops);
+#ifdef BENCH_SDL
+	BenchRender(ops);
+#endif
+	if (optind < argc)
+		BenchRoms(argv[optind], num_cycles);
+	return 0;
+}
@@ -0,0 +1,45 @@
+#include <binio.h>
+#include <cstdio>
+
+bool ReadFile(const char* path, std::vector<uint8_t>& buf){
+	FILE* file = fopen(path, "rb");
+	if (!file){
+		printf("Could not open \"%s\"\n", path);
+		return false;
+	}
+	buf.clear();
+	uint8_t chunk[4096];
+	size_t len;
+	while ((len = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		buf.insert(buf.end(), chunk, chunk + len);
+	bool ok = !ferror(file);
+	fclose(file);
+	if (!ok)
+		printf("Failed to read \"%s\"\n", path);
+	return ok;
+}
+
+bool WriteFile(const char* path, const std::vector<uint8_t>& buf){
+	FILE* file = fopen(path, "wb");
+	if (!file){
+		printf("Could not open \"%s\" for writing\n", path);
+		return false;
+	}
+	bool ok = fwrite(buf.data(), 1, buf.size(), file) == buf.size();
+	ok = (fclose(file) == 0) && ok;
+	if (!ok)
+		printf("Failed to write \"%s\"\n", path);
+	return ok;
+}
+
+uint64_t HashFile(const char* path){
+	std::vector<uint8_t> buf;
+	if (!ReadFile(path, buf))
+		return 0;
+	uint64_t hash = 0xcbf29ce484222325; // FNV offset basis
+	for (uint8_t byte : buf){
+		hash ^= byte;
+		hash *= 0x100000001b3; // FNV prime
+	}
+	return hash;
+}
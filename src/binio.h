@@ -0,0 +1,69 @@
+#ifndef BINIO_H
+#define BINIO_H
+
+#include <stdint.h>
+#include <cstring>
+#include <vector>
+
+// Little-endian writer/reader for the emulator's binary files (save states, recordings) so they can move between hosts
+
+struct Writer {
+	std::vector<uint8_t> buf;
+	void u8(uint8_t x){ buf.push_back(x); }
+	void u16(uint16_t x){ u8(x & 0xFF); u8(x >> 8); }
+	void u32(uint32_t x){ u16(x & 0xFFFF); u16(x >> 16); }
+	void u64(uint64_t x){ u32(x & 0xFFFFFFFF); u32(x >> 32); }
+	// LEB128, 7 bits per byte, for counts that are usually small
+	void varint(uint64_t x){
+		while (x >= 0x80){
+			u8((x & 0x7F) | 0x80);
+			x >>= 7;
+		}
+		u8(x);
+	}
+	void bytes(const void* data, size_t len){
+		const uint8_t* p = (const uint8_t*) data;
+		buf.insert(buf.end(), p, p + len);
+	}
+};
+
+// Reading past the end returns zeros and clears ok, so callers only have to check ok once at the end
+struct Reader {
+	const uint8_t* p;
+	const uint8_t* end;
+	bool ok = true;
+	bool has(size_t len){
+		if ((size_t)(end - p) < len)
+			ok = false;
+		return ok;
+	}
+	bool done() const { return p == end; }
+	uint8_t u8(){ return has(1) ? *p++ : 0; }
+	uint16_t u16(){ uint16_t lo = u8(); return lo | (u8() << 8); }
+	uint32_t u32(){ uint32_t lo = u16(); return lo | ((uint32_t) u16() << 16); }
+	uint64_t u64(){ uint64_t lo = u32(); return lo | ((uint64_t) u32() << 32); }
+	uint64_t varint(){
+		uint64_t x = 0;
+		for (int shift = 0; shift < 64; shift += 7){
+			uint8_t byte = u8();
+			x |= (uint64_t)(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				break;
+		}
+		return x;
+	}
+	void bytes(void* data, size_t len){
+		if (!has(len))
+			return;
+		memcpy(data, p, len);
+		p += len;
+	}
+};
+
+// Whole-file helpers, both print what went wrong
+bool ReadFile(const char* path, std::vector<uint8_t>& buf);
+bool WriteFile(const char* path, const std::vector<uint8_t>& buf);
+// FNV-1a of a file's contents, 0 if it can't be read
+uint64_t HashFile(const char* path);
+
+#endif // BINIO_H
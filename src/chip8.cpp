@@ -3,8 +3,17 @@
 // http://devernay.free.fr/hacks/chip8/C8TECH10.HTM
 // http://www.codeslinger.co.uk/pages/projects/chip8/fetchdecode.html
 #include <chip8.h>
-#include <display.h>
 #include <cpu.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+bool SLOW_MODE = false;
+bool DEBUG_MODE  = false;
+bool VERBOSE_CLOCK = false;
+bool VERBOSE_CPU = false;
+bool VERBOSE_DISPLAY = false;
+bool VERBOSE_INPUT = false;
 
 unsigned char textfont[80] = {
 	// 1,    2, 	3, 	  4, 	5 bytes
@@ -26,6 +35,25 @@ unsigned char textfont[80] = {
 	0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
+unsigned char bigfont[160] = {
+	0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+	0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+	0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+	0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+	0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+	0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+	0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+	0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
 const char* Op::optostr(uint8_t op);
 
 // Chip8 is Big-endian
@@ -76,46 +104,232 @@ const char* Op::optostr(uint8_t op){
 		case DRW: return "DRW";
 		case SKP: return "SKP";
 		case SKNP: return "SKNP";
+		case SCD: return "SCD";
+		case SCR: return "SCR";
+		case SCL: return "SCL";
+		case EXIT: return "EXIT";
+		case LOW: return "LOW";
+		case HIGH: return "HIGH";
 		case ERR: return "ERR";
 		default: return "WTF";
 	}
 	return "ERR";
 }
 
-bool Chip8::LoadROM(const char* rom_path){
-	// Get length of file 
+void Op::disassemble(uint16_t opcode, char* buf, size_t len){
+	unsigned x = Op::x(opcode);
+	unsigned y = Op::y(opcode);
+	unsigned kk = Op::kk(opcode);
+	unsigned nnn = Op::nnn(opcode);
+	unsigned n = Op::n(opcode);
+	switch (opcode & 0xF000){
+		case 0x0000:
+			if (opcode == 0x00E0) snprintf(buf, len, "CLS");
+			else if (opcode == 0x00EE) snprintf(buf, len, "RET");
+			else if ((opcode & 0xFFF0) == 0x00C0) snprintf(buf, len, "SCD %u", n);
+			else if (opcode == 0x00FB) snprintf(buf, len, "SCR");
+			else if (opcode == 0x00FC) snprintf(buf, len, "SCL");
+			else if (opcode == 0x00FD) snprintf(buf, len, "EXIT");
+			else if (opcode == 0x00FE) snprintf(buf, len, "LOW");
+			else if (opcode == 0x00FF) snprintf(buf, len, "HIGH");
+			else snprintf(buf, len, "SYS 0x%03X", nnn);
+			return;
+		case 0x1000: snprintf(buf, len, "JP 0x%03X", nnn); return;
+		case 0x2000: snprintf(buf, len, "CALL 0x%03X", nnn); return;
+		case 0x3000: snprintf(buf, len, "SE V%X, 0x%02X", x, kk); return;
+		case 0x4000: snprintf(buf, len, "SNE V%X, 0x%02X", x, kk); return;
+		case 0x5000: snprintf(buf, len, "SE V%X, V%X", x, y); return;
+		case 0x6000: snprintf(buf, len, "LD V%X, 0x%02X", x, kk); return;
+		case 0x7000: snprintf(buf, len, "ADD V%X, 0x%02X", x, kk); return;
+		case 0x8000:
+			switch (n){
+				case 0x0: snprintf(buf, len, "LD V%X, V%X", x, y); return;
+				case 0x1: snprintf(buf, len, "OR V%X, V%X", x, y); return;
+				case 0x2: snprintf(buf, len, "AND V%X, V%X", x, y); return;
+				case 0x3: snprintf(buf, len, "XOR V%X, V%X", x, y); return;
+				case 0x4: snprintf(buf, len, "ADD V%X, V%X", x, y); return;
+				case 0x5: snprintf(buf, len, "SUB V%X, V%X", x, y); return;
+				case 0x6: snprintf(buf, len, "SHR V%X, V%X", x, y); return;
+				case 0x7: snprintf(buf, len, "SUBN V%X, V%X", x, y); return;
+				case 0xE: snprintf(buf, len, "SHL V%X, V%X", x, y); return;
+			}
+			break;
+		case 0x9000: snprintf(buf, len, "SNE V%X, V%X", x, y); return;
+		case 0xA000: snprintf(buf, len, "LD I, 0x%03X", nnn); return;
+		case 0xB000: snprintf(buf, len, "JP V0, 0x%03X", nnn); return;
+		case 0xC000: snprintf(buf, len, "RND V%X, 0x%02X", x, kk); return;
+		case 0xD000: snprintf(buf, len, "DRW V%X, V%X, %u", x, y, n); return;
+		case 0xE000:
+			if (kk == 0x9E) { snprintf(buf, len, "SKP V%X", x); return; }
+			if (kk == 0xA1) { snprintf(buf, len, "SKNP V%X", x); return; }
+			break;
+		case 0xF000:
+			switch (kk){
+				case 0x07: snprintf(buf, len, "LD V%X, DT", x); return;
+				case 0x0A: snprintf(buf, len, "LD V%X, K", x); return;
+				case 0x15: snprintf(buf, len, "LD DT, V%X", x); return;
+				case 0x18: snprintf(buf, len, "LD ST, V%X", x); return;
+				case 0x1E: snprintf(buf, len, "ADD I, V%X", x); return;
+				case 0x29: snprintf(buf, len, "LD F, V%X", x); return;
+				case 0x30: snprintf(buf, len, "LD HF, V%X", x); return;
+				case 0x33: snprintf(buf, len, "LD B, V%X", x); return;
+				case 0x55: snprintf(buf, len, "LD [I], V%X", x); return;
+				case 0x65: snprintf(buf, len, "LD V%X, [I]", x); return;
+				case 0x75: snprintf(buf, len, "LD R, V%X", x); return;
+				case 0x85: snprintf(buf, len, "LD V%X, R", x); return;
+			}
+			break;
+	}
+	snprintf(buf, len, "ERR 0x%04X", opcode);
+}
+
+RomError Chip8::LoadROM(const char* rom_path, uint16_t load_addr, bool verbose){
+	// Most Chip-8 programs start at location 0x200 (512), but some begin at 0x600 (1536).
+	// Below 0x200 is the interpreter's (and the fonts').
+	if (load_addr < ROM_START || load_addr >= MEM_SIZE)
+		return ROM_BAD_LOAD_ADDR;
 	FILE* rom = fopen(rom_path, "rb");
-	fseek(rom, 0, SEEK_END);
-	uint16_t rom_size = ftell(rom);
-	rewind(rom);
-	printf("ROM size: %i Bytes\n", rom_size);
-	// Allocate memory for rom 
-	uint8_t* rom_buf = (uint8_t*) malloc(rom_size);
-	// Read ROM into memory
-	size_t res = fread(rom_buf, 1, rom_size, rom);
-	if (!res){
-		printf("Failed to load ROM\n");
-		return false;
-	}	
-	// Load ROM into mem at 0x200
-	// Most Chip-8 programs start at location 0x200 (512), but some begin at 0x600 (1536). 
-	printf("BYTES: %zu\n", rom_size / sizeof(uint8_t));
-	memcpy(&this->mem[0x200], rom_buf, (rom_size / sizeof(uint8_t)));
-	free(rom_buf);
-	printf("Rom \"%s\" loaded into memory\n", rom_path);
-	return true;
+	if (!rom)
+		return ROM_OPEN_FAILED;
+	// Get length of file
+	long rom_size = -1;
+	if (!fseek(rom, 0, SEEK_END)){
+		rom_size = ftell(rom);
+		rewind(rom);
+	}
+	RomError err = ROM_OK;
+	if (rom_size < 0)
+		err = ROM_READ_FAILED;
+	else if (rom_size == 0)
+		err = ROM_EMPTY;
+	else if (rom_size > MEM_SIZE - load_addr)
+		err = ROM_TOO_LARGE;
+	// Read it directly into mem, no temporary buffer
+	else if (fread(&this->mem[load_addr], 1, rom_size, rom) != (size_t) rom_size)
+		err = ROM_READ_FAILED;
+	fclose(rom);
+	if (err == ROM_OK && verbose)
+		printf("Rom \"%s\" (%li bytes) loaded into memory at 0x%03X\n", rom_path, rom_size, load_addr);
+	return err;
+}
+
+const char* RomErrorString(RomError err){
+	switch (err){
+		case ROM_OK: return "OK";
+		case ROM_OPEN_FAILED: return "could not open the file";
+		case ROM_READ_FAILED: return "could not read the file";
+		case ROM_EMPTY: return "the file is empty";
+		case ROM_TOO_LARGE: return "the ROM doesn't fit in memory at that load address";
+		case ROM_BAD_LOAD_ADDR: return "the load address has to be between 0x200 and 0xFFF";
+	}
+	return "unknown error";
+}
+
+uint64_t Chip8::HashGFX() const {
+	uint64_t hash = 0xcbf29ce484222325; // FNV offset basis
+	// Only the part of the framebuffer the current resolution uses
+	for (int y = 0; y < Height(); y++){
+		for (int word = 0; word < Width() / 64; word++){
+			for (int shift = 56; shift >= 0; shift -= 8){
+				hash ^= (gfx[y][word] >> shift) & 0xFF;
+				hash *= 0x100000001b3; // FNV prime
+			}
+		}
+	}
+	return hash;
+}
+
+void Chip8::ClearScreen(){
+	memset(gfx, 0, sizeof(gfx));
+	draw_flag = true;
+}
+
+void Chip8::SetHires(bool on){
+	hires = on;
+	ClearScreen();
+}
+
+bool Chip8::DrawSprite(uint8_t x, uint8_t y, const uint8_t* rows, uint8_t n, bool wide){
+	int height = Height();
+	x %= Width();
+	y %= height;
+	uint64_t collision = 0;
+	for (uint8_t dy = 0; dy < n; dy++){
+		int row = y + dy;
+		if (row >= height){
+			if (!wrap_sprites)
+				break;
+			row -= height;
+		}
+		// Line the sprite row up with the left edge, then move it over to x
+		uint64_t bits = wide ? (uint64_t)(rows[2 * dy] << 8 | rows[2 * dy + 1]) << (64 - BIG_SPRITE_WIDTH)
+			: (uint64_t) rows[dy] << (64 - SPRITE_WIDTH);
+		if (!hires){
+			// Low resolution rows are a single word
+			if (wrap_sprites)
+				bits = (x) ? (bits >> x) | (bits << (DISP_X - x)) : bits;
+			else
+				bits >>= x;
+			collision |= gfx[row][0] & bits;
+			gfx[row][0] ^= bits;
+			continue;
+		}
+		// 128 pixels wide. Sprites are at most 16 pixels, so only one starting in the right word can go past the edge.
+		uint64_t left, right;
+		if (x < 64){
+			left = bits >> x;
+			right = (x) ? bits << (64 - x) : 0;
+		} else {
+			left = (wrap_sprites && x > 64) ? bits << (HIRES_X - x) : 0;
+			right = bits >> (x - 64);
+		}
+		collision |= (gfx[row][0] & left) | (gfx[row][1] & right);
+		gfx[row][0] ^= left;
+		gfx[row][1] ^= right;
+	}
+	draw_flag = true;
+	return collision != 0;
+}
+
+void Chip8::ScrollDown(uint8_t n){
+	int height = Height();
+	if (n > height)
+		n = height;
+	memmove(gfx[n], gfx[0], (height - n) * sizeof(gfx[0]));
+	memset(gfx[0], 0, n * sizeof(gfx[0]));
+	draw_flag = true;
+}
+
+void Chip8::ScrollRight(uint8_t n){
+	if (!n)
+		return;
+	for (int y = 0; y < Height(); y++){
+		// In low resolution word 0 is the whole row and whatever leaves it is dropped
+		if (hires)
+			gfx[y][1] = (gfx[y][1] >> n) | (gfx[y][0] << (64 - n));
+		gfx[y][0] >>= n;
+	}
+	draw_flag = true;
+}
+
+void Chip8::ScrollLeft(uint8_t n){
+	if (!n)
+		return;
+	for (int y = 0; y < Height(); y++){
+		gfx[y][0] <<= n;
+		if (hires){
+			gfx[y][0] |= gfx[y][1] >> (64 - n);
+			gfx[y][1] <<= n;
+		}
+	}
+	draw_flag = true;
 }
 
 // Load font set into memory
 void Chip8::LoadFont(uint8_t* font){
-	memcpy(this->mem, font, (0x80 / sizeof(uint8_t)));
+	memcpy(this->mem, font, sizeof(textfont));
+	memcpy(this->mem + BIG_FONT_ADDR, bigfont, sizeof(bigfont));
 }
 
-void ExitChip8(){
-	printf("Exiting... Goodbye!\n");
-	SDL_DestroyWindow(window);
-	SDL_Quit();
-	exit(EXIT_SUCCESS);
-}
 
 
@@ -16,11 +16,22 @@
 #define NUM_KEYS 16
 #define DISP_X 64
 #define DISP_Y 32
+// SUPER-CHIP high resolution mode
+#define HIRES_X 128
+#define HIRES_Y 64
+#define GFX_WORDS (HIRES_X / 64) // 64-bit words per framebuffer row
 #define SPRITE_WIDTH 8
+#define BIG_SPRITE_WIDTH 16 // Dxy0, SUPER-CHIP 16x16 sprites
+#define BIG_FONT_ADDR 0x50 // The SUPER-CHIP 8x10 font goes right after textfont
+#define NUM_RPL 16 // SUPER-CHIP RPL user flags (Fx75/Fx85)
 #define MSB_POS 7 // MSB index of an 8-bit number
+#define ROM_START 0x200 // Where programs are loaded and start running, unless told otherwise
+#define ETI_ROM_START 0x600 // ETI 660 programs start here instead
 
 // 1/60 = 0.16666666 * 10^3 = 16667
 #define TICK 16667
+// Instructions executed per 60Hz tick (~1000 instructions per second)
+#define CYCLES_PER_FRAME 16
 
 extern bool SLOW_MODE;
 extern bool DEBUG_MODE; // Frame by frame execution
@@ -34,18 +45,27 @@ class Chip8;
 // See section 2.4 - Display
 // These sprites are 5 bytes long.
 extern unsigned char textfont[80];
-// Destroy SDL and exit
-void ExitChip8();
+// SUPER-CHIP large digits for Fx30, 10 bytes each
+extern unsigned char bigfont[160];
+
+// Why LoadROM failed
+enum RomError {
+	ROM_OK, ROM_OPEN_FAILED, ROM_READ_FAILED, ROM_EMPTY, ROM_TOO_LARGE, ROM_BAD_LOAD_ADDR
+};
+const char* RomErrorString(RomError err);
 
 namespace Op {
 	enum { CLS, RET, SYS, JP, CALL, 
 		SE, SNE, LD, ADD, LDR, 
 		OR, AND, XOR, SUB, SHR, 
 		SUBN, SHL, RND, DRW, SKP,
-		SKNP, ERR
+		SKNP, SCD, SCR, SCL, EXIT,
+		LOW, HIGH, ERR
 	};
 
 	const char* optostr(uint8_t op);
+	// Assembly text for an opcode, e.g. 0x8124 -> "ADD V1, V2". Writes at most len bytes to buf.
+	void disassemble(uint16_t opcode, char* buf, size_t len);
 
 	// Chip8 is Big-endian
 	// Big-endian reads from msb -> lsb
@@ -67,27 +87,51 @@ namespace Op {
 class Chip8 {
 	public:
 		uint8_t mem[MEM_SIZE] = {0}; // mem of the chip8
-		bool gfx[DISP_X * DISP_Y] = {0}; // 64x32 display
+		// 128x64 display, GFX_WORDS 64-bit words per row. The MSB of word 0 is the leftmost pixel (x = 0), same bit order
+		// as sprites. In low resolution only the top-left 64x32 pixels are used, i.e. word 0 of the first 32 rows.
+		uint64_t gfx[HIRES_Y][GFX_WORDS] = {{0}};
 		bool keys[NUM_KEYS] = {0}; // array of all keys from 0-F, 1 if pressed, 0 if unpressed
 		bool draw_flag = false; // draw flag
-
-		// Load ROM into memory
-		bool LoadROM(const char* rom_path);
+		bool wrap_sprites = false; // Sprites wrap around the screen edges instead of being clipped
+		bool hires = false; // SUPER-CHIP 128x64 mode
+
+		// Read a ROM straight into memory at load_addr (ROM_START..MEM_SIZE-1). The whole file has to fit below MEM_SIZE,
+		// nothing is loaded otherwise. The CPU's pc is left to the caller.
+		RomError LoadROM(const char* rom_path, uint16_t load_addr = ROM_START, bool verbose = true);
+		// FNV-1a hash of the framebuffer, for comparing runs
+		uint64_t HashGFX() const;
+
+		// Size of the current resolution
+		int Width() const { return hires ? HIRES_X : DISP_X; }
+		int Height() const { return hires ? HIRES_Y : DISP_Y; }
+
+		// Framebuffer accessors
+		bool GetPixel(uint8_t x, uint8_t y) const { return (gfx[y][x / 64] >> (63 - x % 64)) & 1; }
+		void ClearScreen();
+		// Switch between 64x32 and 128x64, the screen is cleared
+		void SetHires(bool on);
+		// XORs an n row tall sprite onto the screen at (x, y), a whole row at a time. Sprites are 8 pixels wide with
+		// one byte per row, or 16 pixels wide with two bytes per row when wide is set.
+		// The starting position wraps around the screen, the rest of the sprite is clipped or wrapped depending on
+		// wrap_sprites. Returns true if any pixel was turned off (the collision flag).
+		bool DrawSprite(uint8_t x, uint8_t y, const uint8_t* rows, uint8_t n, bool wide = false);
+		// SUPER-CHIP scrolling, whole rows are moved at once. Pixels scrolled in are blank.
+		void ScrollDown(uint8_t n);
+		void ScrollRight(uint8_t n); // n < 64
+		void ScrollLeft(uint8_t n); // n < 64
 
 		// Constructors
 		Chip8(){
-			srand(time(0)); // Init RNG
 			LoadFont(textfont);
 		}
 
 		Chip8(const char* rom_path){
-			srand(time(0)); // Init RNG
 			LoadFont(textfont);
 			LoadROM(rom_path);
 		}
 
 	private:
-		// Load font set into memory
+		// Load font set (and the large SUPER-CHIP font) into memory
 		void LoadFont(uint8_t* font);
 };
 
@@ -1,31 +1,64 @@
 #include <chrono>
 #include <clock.h>
-#include <input.h>
+#include <trace.h>
 #include <iostream>
 #include <utility>
 
-// Global tick counter 
-uint64_t G_ticks_elapsed = 0;
+#ifdef __linux__
+#include <cerrno>
+#include <time.h>
+#endif
 
-// TICK is the constant time representing the length of each tick in microseconds. 
-void Clock::tick(){
-	if (high_resolution_clock::now() - tick_start > std::chrono::microseconds(TICK)){
-		G_ticks_elapsed++;		
-		if (VERBOSE_CLOCK) printf("Tick: %zu\n", G_ticks_elapsed);
-		if (G_ticks_elapsed % 60 == 0){
-			this->seconds_elapsed++;
-			if (VERBOSE_CLOCK) printf("Seconds Elapsed: %u\n", this->seconds_elapsed);
-		}
-		// Start a new tick
-		this->tick_start = std::chrono::high_resolution_clock::now();
+// Count the tick that just ended and move the deadline on by exactly one period
+void Clock::next_tick(steady_clock::time_point now){
+	ticks++;
+	if (tracer) tracer->Tick(ticks);
+	deadline += period;
+	if (now - deadline >= period * CLOCK_MAX_BEHIND){
+		// Too far behind to catch up, start counting again from now
+		uint64_t behind = (now - deadline) / period;
+		skipped_ticks += behind;
+		deadline += period * behind;
 	}
 }
 
-// Stop calling thread for specified number of ticks
-void Clock::wait(uint16_t num_ticks){
-	if (VERBOSE_CLOCK) printf("Clock waiting for %i ticks\n", num_ticks);
-	std::this_thread::sleep_for(std::chrono::microseconds(TICK * num_ticks));
+void Clock::tick(){
+	auto now = steady_clock::now();
+	if (now >= deadline)
+		next_tick(now);
+}
 
+// Stop calling thread until the current tick is over
+void Clock::wait_tick(){
+	sleep_until(deadline);
+	auto now = steady_clock::now();
+	auto lateness = std::chrono::duration_cast<std::chrono::nanoseconds>(now - deadline);
+	waits++;
+	total_lateness += lateness;
+	max_lateness = std::max(max_lateness, lateness);
+	if (lateness > std::chrono::microseconds(CLOCK_LATE_US))
+		late_ticks++;
+	next_tick(now);
 }
 
+void Clock::sleep_until(steady_clock::time_point time){
+#ifdef __linux__
+	// steady_clock is CLOCK_MONOTONIC, sleeping to an absolute time means a signal or a late wakeup can't add up
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+	timespec ts;
+	ts.tv_sec = ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+#else
+	std::this_thread::sleep_until(time);
+#endif
+}
 
+void Clock::print_stats(){
+	printf("Clock: %llu ticks", (unsigned long long) ticks);
+	if (waits)
+		printf(", woke up %.3fms late on average, %.3fms at most, %llu more than %.1fms late",
+				total_lateness.count() / 1e6 / waits, max_lateness.count() / 1e6,
+				(unsigned long long) late_ticks, CLOCK_LATE_US / 1e3);
+	printf(", %llu skipped\n", (unsigned long long) skipped_ticks);
+}
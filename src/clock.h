@@ -6,22 +6,43 @@
 #include <chrono>
 #include <thread>
 #include <functional>
-using std::chrono::high_resolution_clock;
+using std::chrono::steady_clock;
 
-extern uint64_t G_ticks_elapsed;
+// Ticks a clock can fall behind before it gives up on them and starts again from now, instead of running
+// the missed ones back to back (after a stall, a breakpoint or the machine going to sleep)
+#define CLOCK_MAX_BEHIND 3
+// Wakeups later than this past their deadline count as late
+#define CLOCK_LATE_US 1000
 
+class Tracer;
+
+/* 60Hz tick clock. Every tick has an absolute deadline, one period after the last one, rather than starting whenever
+ * the previous tick happened to be noticed, so waking up late for one tick doesn't push back all the ones after it.
+ * wait_tick sleeps straight through to the deadline (clock_nanosleep on Linux), nothing polls in between. */
 class Clock {
 public:
-	// Constructor
-	Clock() : init_time(high_resolution_clock::now()), tick_start(high_resolution_clock::now()) {}
+	Clock(std::chrono::nanoseconds period = std::chrono::microseconds(TICK)) :
+		period(period), deadline(steady_clock::now() + period) {}
+
+	Tracer* tracer = nullptr; // Gets a record for every tick when set
 
-	void wait(uint16_t num_ticks); // Wait for a certain number of ticks
-	void tick(); // Count ticks (should called in the main while loop)
-	void print_ticks_elapsed();
+	uint64_t ticks = 0; // Ticks counted so far
+	// Lateness of wait_tick's wakeups
+	uint64_t waits = 0;
+	uint64_t late_ticks = 0; // Woke up more than CLOCK_LATE_US after the deadline
+	uint64_t skipped_ticks = 0; // Given up on after falling CLOCK_MAX_BEHIND ticks behind
+	std::chrono::nanoseconds total_lateness{0};
+	std::chrono::nanoseconds max_lateness{0};
+
+	void tick(); // Count the current tick if its deadline has passed, for running without waiting
+	void wait_tick(); // Sleep until the current tick's deadline, then count it
+	void print_stats();
 private:
-	uint32_t seconds_elapsed = 0;
-	high_resolution_clock::time_point init_time; 
-	high_resolution_clock::time_point tick_start; // The starting time_point of the current tick
+	std::chrono::nanoseconds period;
+	steady_clock::time_point deadline; // When the current tick ends
+
+	void next_tick(steady_clock::time_point now);
+	static void sleep_until(steady_clock::time_point time);
 };
 
 #endif // CLOCK_H
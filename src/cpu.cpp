@@ -1,27 +1,89 @@
 #include <cpu.h>
 #include <chip8.h>
-#include <input.h>
+#include <jit.h>
+#include <profiler.h>
+#include <trace.h>
 
 
 // Chip-8 instructions are 2 bytes (16-bits) long 
 void CPU::cycle(){
-	// Fetch the next opcode (read 16 bits)
-	this->opcode = mem[pc] << 8 | mem[pc + 1];
-	uint8_t op = decode(this->opcode);
-	execute(op);
-	pc += 2; // increment program counter
+	// Run the cached instruction, decoding it first if it isn't cached yet
+	const Instruction& ins = icache[pc & (MEM_SIZE - 1)];
+	if (!ins.handler)
+		predecode(pc);
+	this->opcode = ins.opcode;
+	if (profiler) profiler->Count(pc, ins.opcode);
+	uint16_t addr = pc;
+	ins.handler(*this, ins);
+	pc = (pc + 2) & (MEM_SIZE - 1); // increment program counter, jumps and skips past the end wrap around like mem does
+	if (tracer) tracer->Instruction(addr, ins.opcode);
 }
 
-// Counts down dt when it is non-zero (60Hz, i.e. 1/60 seconds per tick)
-void CPU::delay_timer(){
-	if (this->dt){
-		clock->wait(this->dt); // Wait for ticks to process
-		this->dt = 0x0; // set dt to 0
-	}
-	if (!SLOW_MODE)
-		std::this_thread::sleep_for(std::chrono::microseconds(1000));
-	else 
-		std::this_thread::sleep_for(std::chrono::microseconds(TICK * 2));
+void CPU::step(){
+	this->opcode = mem[pc] << 8 | mem[(pc + 1) & (MEM_SIZE - 1)];
+	execute(decode(this->opcode));
+	pc = (pc + 2) & (MEM_SIZE - 1);
+}
+
+size_t CPU::run(size_t num_cycles){
+	size_t executed = 0;
+	while (executed < num_cycles){
+		// The JIT is skipped while tracing or profiling so every instruction gets seen
+		if (jit && !tracer && !profiler){
+			size_t n = jit->run(this, num_cycles - executed);
+			if (n){
+				executed += n;
+				cycles += n;
+				continue;
+			}
+		}
+		cycle();
+		executed++;
+		cycles++;
+	}
+	return executed;
+}
+
+// xorshift32, small enough to copy into a save state
+uint32_t CPU::random(){
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+void CPU::seed(uint32_t seed){
+	// Multiplying by an odd constant spreads small seeds over all the bits, xorshift just can't start from 0
+	rng_state = seed * 0x9E3779B9;
+	if (!rng_state)
+		rng_state = 1;
+}
+
+void CPU::wait_key(uint8_t x){
+	uint16_t held = 0;
+	for (int k = 0; k < NUM_KEYS; k++)
+		held |= chip8->keys[k] << k;
+	if (!key_wait){
+		// Keys already down when the wait starts don't count until they're pressed again
+		key_wait = true;
+		key_wait_held = held;
+		key_wait_pressed = 0;
+	}
+	key_wait_pressed |= held & ~key_wait_held;
+	key_wait_held = held;
+	uint16_t released = key_wait_pressed & ~held;
+	if (!released){
+		pc -= 2; // No key yet, run Fx0A again next cycle
+		return;
+	}
+	v[x] = __builtin_ctz(released);
+	key_wait = false;
+}
+
+// Counts down dt and st by a single tick (60Hz, i.e. 1/60 seconds per tick). The Scheduler decides when a tick happens.
+void CPU::tick_timers(){
+	if (this->dt) this->dt--;
+	if (this->st) this->st--;
 }
 
 uint8_t CPU::decode(uint16_t opcode){
@@ -35,8 +97,24 @@ uint8_t CPU::decode(uint16_t opcode){
 				case 0x00EE: // 0xEE no args
 					op = Op::RET; 
 					break;
-				default: // 0nnn addr
-					op = Op::SYS; 
+				// SUPER-CHIP
+				case 0x00FB: // 00FB - SCR
+					op = Op::SCR;
+					break;
+				case 0x00FC: // 00FC - SCL
+					op = Op::SCL;
+					break;
+				case 0x00FD: // 00FD - EXIT
+					op = Op::EXIT;
+					break;
+				case 0x00FE: // 00FE - LOW
+					op = Op::LOW;
+					break;
+				case 0x00FF: // 00FF - HIGH
+					op = Op::HIGH;
+					break;
+				default: // 0nnn addr, or 00Cn - SCD nibble
+					op = ((opcode & 0x00F0) == 0x00C0) ? Op::SCD : Op::SYS;
 					break;
 			}
 			break;
@@ -128,8 +206,11 @@ uint8_t CPU::decode(uint16_t opcode){
 				case 0x0018: // Fx18 - LD ST, Vx
 				case 0x0033: // Fx33 - LD B, Vx
 				case 0x0029: // Fx29 - LD F, Vx
+				case 0x0030: // Fx30 - LD HF, Vx
 				case 0x0055: // Fx55 - LD [I], Vx
 				case 0x0065: // Fx65 - LD Vx, [I]
+				case 0x0075: // Fx75 - LD R, Vx
+				case 0x0085: // Fx85 - LD Vx, R
 					op = Op::LD;
 					break;
 				case 0x001E: // Fx1E - ADD I, Vx
@@ -150,8 +231,6 @@ uint8_t CPU::decode(uint16_t opcode){
 
 // Execute CPU instructions
 void CPU::execute(uint8_t op){
-	const char* description = "";
-	const char* opstr = Op::optostr(op);
 	size_t x = Op::x(opcode); // x - A 4-bit value, the lower 4 bits of the high byte of the instruction
 	size_t y = Op::y(opcode); // y - A 4-bit value, the upper 4 bits of the low byte of the instruction
 	uint8_t kk = Op::kk(opcode); // kk or byte - An 8-bit value, the lowest 8 bits of the instruction
@@ -165,12 +244,10 @@ void CPU::execute(uint8_t op){
 			{
 				switch(opcode & 0xF000){
 					case 0x7000: // ADD Vx, byte
-						description = "Vx, kk";
 						v[x] += kk;
 						break;
 					case 0x8000: // 8xy4 ADD Vx, Vy
 						{
-							description = "Vx, Vy";
 							v[x] += v[y];
 							if (v[y] > v[x]){ 
 								// Carry flag
@@ -181,7 +258,6 @@ void CPU::execute(uint8_t op){
 							break;
 						}
 					case 0xF000: // Fx1E ADD I = I + Vx
-						description = "I, Vx";
 						this->i += v[x];
 						break;
 				}
@@ -189,19 +265,16 @@ void CPU::execute(uint8_t op){
 			}
 		case Op::AND: // 8xy2 - AND Vx, Vy
 					  // Set Vx = Vx AND Vy.
-			description = "Vx, Vy";
 			v[x] &= v[y];
 			break;
 		case Op::CALL: // 2nnn - Call subroutine
-			stack.push(pc);
+			push(pc);
 			pc = nnn; // Store address into program counter
 			pc -= 2;
 			break;
 		case Op::CLS: // 0x00E0 - Clear screen
 					  // Clear 64x32 display
-			for(int i = 0; i < DISP_X*DISP_Y; i++)
-				chip8->gfx[i] = 0;
-			chip8->draw_flag = true;
+			chip8->ClearScreen();
 			break;
 		case Op::JP: // Jump
 			{
@@ -210,12 +283,10 @@ void CPU::execute(uint8_t op){
 						if (VERBOSE_CPU) printf("\nError: Invalid opcode {%04X}\n", opcode);
 						break;
 					case 0x1000: // 1nnn - jump to address nnn
-						description = "addr";
 						pc = nnn;
 						pc -= 2;
 						break;
 					case 0xB000: // Bnnn - jump to address nnn + v[0]
-						description = "V0, addr";
 						pc = nnn + v[0];
 						pc -= 2;
 						break;
@@ -223,45 +294,8 @@ void CPU::execute(uint8_t op){
 				break;
 			}
 		case Op::DRW: // Dxyn - Draw
-			{
-				description = "Vx, Vy, nibble";
-				/* Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels. 
-				 * Each row of 8 pixels is read as bit-coded starting from memory location I; I value does not 
-				 * change after the execution of this instruction. As described above, VF is set to 1 if any 
-				 * screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that does not happen 
-				 */
-				// Dxyn
-				// Each sprite will always be 8 pixels wide
-				// The nibble, n is the height we will draw */
-				v[0xF] = 0;
-				// Here, we need to get the actual values from the V registers 
-				// This is different from the x,y functions defined in Op::, as those extract the bits from the opcode itself.
-				uint8_t px;
-				// Reduce if overflow
-				if (v[x] > DISP_X) v[x] %= DISP_X;
-				if (v[y] > DISP_Y) v[y] %= DISP_Y;
-
-				// dy and dx are the positions of the line being drawn, relative to their V value counterparts.
-				for (int dy = 0; dy < n; dy++){
-
-					// px = mem[this->i + dy];
-					px = mem[this->i + dy];
-					for(int dx = 0; dx < 8; dx++){
-
-						if(px & (0x80 >> dx)){
-							// and if gfx is set
-							if(chip8->gfx[(v[x] + dx + ((v[y] + dy) * DISP_X))]){
-								// Set VF flag to 1 indicating that at least one pixel was unset
-								v[0xF] = 1;
-							}
-							chip8->gfx[v[x] + dx + ((v[y] + dy) * DISP_X)] ^= 1;
-						}
-					}
-				}
-
-				chip8->draw_flag = true;
-				break;
-			}
+			draw(x, y, n);
+			break;
 		case Op::LD: 	
 			{
 				switch(opcode & 0xF000){
@@ -269,15 +303,12 @@ void CPU::execute(uint8_t op){
 						if (VERBOSE_CPU) printf("\nError: Invalid opcode {%04X}\n", opcode);
 						break;
 					case 0x6000: // 6xkk - Set Vx to kk
-						description = "Vx, kk";
 						v[x] = kk;
 						break;
 					case 0x8000: // 8xy0 - Set Vx to Vy
-						description = "Vx, Vy";
 						v[x] = v[y];
 						break;
 					case 0xA000: // Annn - Set i to address nnn
-						description = "I, addr";
 						this->i = nnn;
 						break;
 					case 0xF000:
@@ -286,58 +317,65 @@ void CPU::execute(uint8_t op){
 								if (VERBOSE_CPU) printf("\nError: Invalid opcode {%04X}\n", opcode);
 								break;
 							case 0x0007: // Fx07 - LD Vx, DT "load DT into Vx"
-								description = "Vx, DT";
 								v[x] = dt;
 								break;
 							case 0x000A: // Fx0A - LD Vx, K
-								description = "Vx, K";
-								v[x] = key_map[InputHandler::WaitForKeyPress()];
+								wait_key(x);
 								break;
 							case 0x0015: // Fx15 - LD DT, Vx
-								description = "DT, Vx";
 								dt = v[x];
 								break;
 							case 0x0018: // Fx18 - LD ST, Vx
-								description = "ST, Vx";
 								st = v[x];
 								break;
 							case 0x0029: // Fx29 - LD F, Vx
-								description = "F, Vx";
 								// The value of I is set to the location for the hexadecimal sprite corresponding to the value of Vx. 
 								this->i = v[x] * 0x5; // Each font is 5 bytes wide (as shown in textfont) 
 								break;
+							case 0x0030: // Fx30 - LD HF, Vx
+								// Same for the large SUPER-CHIP digits, 10 bytes each
+								this->i = BIG_FONT_ADDR + (v[x] & 0xF) * 10;
+								break;
 							case 0x0033: // Fx33 - LD B, Vx
-								description = "B, Vx";
 								// Store BCD representation of Vx in mem locations i, i+1, and I+2.
 								// BCD = Binary coded representation, see https://www.techtarget.com/whatis/definition/binary-coded-decimal
-								mem[this->i] = v[x] / 100; // Load 100s place into memory
-								mem[this->i+1] = (v[x] / 10) % 10; // Load 10s place into memory
-								mem[this->i+2] = v[x] % 10; // Load 1s place into memory
+								// I can point anywhere up to 0xFFFF, addresses wrap around mem like they do for DRW
+								mem[this->i & (MEM_SIZE - 1)] = v[x] / 100; // Load 100s place into memory
+								mem[(this->i+1) & (MEM_SIZE - 1)] = (v[x] / 10) % 10; // Load 10s place into memory
+								mem[(this->i+2) & (MEM_SIZE - 1)] = v[x] % 10; // Load 1s place into memory
+								invalidate(this->i, 3);
 								break;
 							case 0x0055: // Fx55 - LD [I], Vx
-								description = "[I], Vx";
 								for (uint8_t i = 0; i <= x; i++){
 									// Stores from V0 to VX (including VX) into memory, starting at address I. The offset from I is increased by 1 for each value written, 
 									// but I itself is left unmodified.
-									mem[this->i + i] = v[i];
+									mem[(this->i + i) & (MEM_SIZE - 1)] = v[i];
 								}
 								// this->i += x + 1;
+								invalidate(this->i, x + 1);
 								break;
 							case 0x0065: // Fx65 - LD Vx, [I]
-								description = "Vx [I]";
 								// Read from memory starting at address I into v registers
 								for (uint8_t i = 0; i <= x; i++){
-									v[i] = mem[this->i + i];
+									v[i] = mem[(this->i + i) & (MEM_SIZE - 1)];
 								}
 
 								// this->i += x + 1;
 								break;	
+							case 0x0075: // Fx75 - LD R, Vx
+								// Save V0..Vx in the RPL user flags
+								for (uint8_t i = 0; i <= x; i++)
+									rpl[i] = v[i];
+								break;
+							case 0x0085: // Fx85 - LD Vx, R
+								for (uint8_t i = 0; i <= x; i++)
+									v[i] = rpl[i];
+								break;
 						}
 				}
 				break;
 			}
 		case Op::OR: // 8xy1 - OR Vx, Vy
-			description = "Vx, Vy";
 			// Set Vx = Vx OR Vy.
 			v[x] |= v[y];
 			break;
@@ -348,7 +386,6 @@ void CPU::execute(uint8_t op){
 					break;
 					// 3xkk - SE Vx, byte
 				case 0x3000:
-					description = "Vx, kk";
 					// The interpreter compares register Vx to kk, and if they are equal, 
 					// increments the program counter by 2.
 					if (v[x] == kk)
@@ -356,7 +393,6 @@ void CPU::execute(uint8_t op){
 					break;
 					// 5xy0 - SE Vx, Vy
 				case 0x5000:
-					description = "Vx, Vy";
 					// Skip next instruction if Vx = Vy.
 					if (v[x] == v[y])
 						pc += 2;
@@ -367,14 +403,12 @@ void CPU::execute(uint8_t op){
 			switch (opcode & 0xF000){
 				// 4xkk - SNE Vx, byte
 				case 0x4000:
-					description = "Vx, kk";
 					// Skip next instruction if Vx != kk
 					if (v[x] != kk)
 						pc += 2;
 					break;
 					// 9xy0 - SNE Vx, Vy
 				case 0x9000: 
-					description = "Vx, Vy";
 					// 9xy0 - SNE Vx, Vy
 					// Skip next instruction if Vx != Vy.
 					if (v[x] != v[y])
@@ -383,14 +417,12 @@ void CPU::execute(uint8_t op){
 			}
 			break;
 		case Op::SHL: // 8xyE - SHL Vx {, Vy}
-			description = "Vx {, Vy}";
 			// The 0-based index of the msb in an 8-bit number is 7.
 			v[0xF] = v[x] >> MSB_POS;
 			// Shift vy left once and store it in vx
 			v[x] <<= 1;
 			break;
 		case Op::SHR: // 8xy6 - SHR Vx {, Vy}
-			description = "Vx {, Vy}";
 			// Set Vx = Vx SHR 1.
 			// Store LSB in vf
 			v[0xF] = v[x] & 1;
@@ -398,19 +430,16 @@ void CPU::execute(uint8_t op){
 			v[x] >>= 1;
 			break;
 		case Op::SKP: // Ex9E - SKP Vx "Skip if pressed"
-			description = "Vx";
-			// Skip next instruction if key with value of Vx is pressed
-			if (chip8->keys[v[x]]){ // If key is pressed
+			// Skip next instruction if key with value of Vx is pressed, only the low nibble names a key
+			if (chip8->keys[v[x] & 0xF]){ // If key is pressed
 				pc += 2;
 			} 
 			break;
 		case Op::SKNP: // ExA1 - SKNP Vx "Skip if not pressed"
-			description = "Vx";
-			if (!chip8->keys[v[x]]) // If key is not pressed
+			if (!chip8->keys[v[x] & 0xF]) // If key is not pressed
 				pc += 2;
 			break;
 		case Op::SUB: // 8xy5 - SUB Vx, Vy
-			description = "Vx, Vy";
 			// If Vx > Vy, then VF is set to 1, otherwise 0. 
 			if (v[x] > v[y])
 				v[0xF] = 1; 	
@@ -421,7 +450,6 @@ void CPU::execute(uint8_t op){
 			v[x] -= v[y];
 			break;
 		case Op::SUBN: // 8xy7 - SUBN Vx, Vy
-			description = "Vx, Vy";
 			// Set Vx = Vy - Vx, set VF = NOT borrow.
 			// If Vy > Vx, then VF is set to 1, otherwise 0. 
 			if (v[y] > v[x])
@@ -432,30 +460,361 @@ void CPU::execute(uint8_t op){
 			v[x] = v[y] - v[x];
 			break;
 		case Op::RET: // 00EE - RET "Return"
-			pc = stack.top();
-			stack.pop();
+			pc = pop();
 			break;
 		case Op::RND: // RND Vx, byte
-			description = "Vx, kk";
-			v[x] = (rand() % 0xFF) & kk; // Set Vx to random # from (0-255), then & kk
+			v[x] = (random() % 0xFF) & kk; // Set Vx to random # from (0-255), then & kk
 			break;
 		case Op::SYS: // Ignored
 			break;
+		case Op::SCD: // 00Cn - Scroll down n rows
+			chip8->ScrollDown(n);
+			break;
+		case Op::SCR: // 00FB - Scroll right 4 pixels
+			chip8->ScrollRight(4);
+			break;
+		case Op::SCL: // 00FC - Scroll left 4 pixels
+			chip8->ScrollLeft(4);
+			break;
+		case Op::EXIT: // 00FD - Exit the interpreter, we just stay on it
+			pc -= 2;
+			break;
+		case Op::LOW: // 00FE - 64x32 mode
+			chip8->SetHires(false);
+			break;
+		case Op::HIGH: // 00FF - 128x64 mode
+			chip8->SetHires(true);
+			break;
 		case Op::XOR: // 8xy3 - XOR Vx, Vy
-			description = "Vx, Vy";
 			// Performs a bitwise XOR on the values of Vx and Vy, then stores the result in Vx.
 			v[x] ^= v[y];
 			break;
 		case Op::ERR:
-			if (VERBOSE_CPU) printf("You fucked up kid\n");
+			invalid_opcodes++;
 			break;
 	}
-	if (VERBOSE_CPU){
-		printf("0x%04X: 0x%04X %s %s\n", pc, opcode, opstr, description);
-		print_args(opcode);
-		print_registers();
+}
+
+// Dxyn - Draw
+void CPU::draw(size_t x, size_t y, uint8_t n){
+	/* Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels. 
+	 * Each row of 8 pixels is read as bit-coded starting from memory location I; I value does not 
+	 * change after the execution of this instruction. As described above, VF is set to 1 if any 
+	 * screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that does not happen 
+	 */
+	// Here, we need to get the actual values from the V registers 
+	// This is different from the x,y functions defined in Op::, as those extract the bits from the opcode itself.
+	// Dxy0 is a SUPER-CHIP 16x16 sprite, two bytes per row
+	bool wide = (n == 0);
+	uint8_t rows[2 * BIG_SPRITE_WIDTH];
+	int len = wide ? sizeof(rows) : n;
+	for (int b = 0; b < len; b++)
+		rows[b] = mem[(this->i + b) & (MEM_SIZE - 1)];
+	v[0xF] = chip8->DrawSprite(v[x], v[y], rows, wide ? BIG_SPRITE_WIDTH : n, wide) ? 1 : 0;
+}
+
+/* Predecoded instruction handlers
+ * Each handler implements exactly one opcode pattern with its operands already extracted, so cycle() only has to
+ * make one indirect call per instruction. They must behave exactly like their case in execute(). */
+namespace {
+	// Invalid opcode, only counted like in execute()
+	void op_ERR(CPU& cpu, const Instruction& ins){
+		cpu.invalid_opcodes++;
+	}
+	// 00E0 - CLS
+	void op_CLS(CPU& cpu, const Instruction& ins){
+		cpu.chip8->ClearScreen();
+	}
+	// 00EE - RET
+	void op_RET(CPU& cpu, const Instruction& ins){
+		cpu.pc = cpu.pop();
+	}
+	// 0nnn - SYS addr (ignored)
+	void op_SYS(CPU& cpu, const Instruction& ins){}
+	// 00Cn - SCD nibble
+	void op_SCD(CPU& cpu, const Instruction& ins){
+		cpu.chip8->ScrollDown(ins.n);
+	}
+	// 00FB - SCR
+	void op_SCR(CPU& cpu, const Instruction& ins){
+		cpu.chip8->ScrollRight(4);
+	}
+	// 00FC - SCL
+	void op_SCL(CPU& cpu, const Instruction& ins){
+		cpu.chip8->ScrollLeft(4);
+	}
+	// 00FD - EXIT
+	void op_EXIT(CPU& cpu, const Instruction& ins){
+		cpu.pc -= 2;
+	}
+	// 00FE - LOW
+	void op_LOW(CPU& cpu, const Instruction& ins){
+		cpu.chip8->SetHires(false);
 	}
+	// 00FF - HIGH
+	void op_HIGH(CPU& cpu, const Instruction& ins){
+		cpu.chip8->SetHires(true);
+	}
+	// 1nnn - JP addr
+	void op_JP(CPU& cpu, const Instruction& ins){
+		cpu.pc = ins.nnn - 2;
+	}
+	// 2nnn - CALL addr
+	void op_CALL(CPU& cpu, const Instruction& ins){
+		cpu.push(cpu.pc);
+		cpu.pc = ins.nnn - 2;
+	}
+	// 3xkk - SE Vx, byte
+	void op_SE_byte(CPU& cpu, const Instruction& ins){
+		if (cpu.v[ins.x] == ins.kk)
+			cpu.pc += 2;
+	}
+	// 4xkk - SNE Vx, byte
+	void op_SNE_byte(CPU& cpu, const Instruction& ins){
+		if (cpu.v[ins.x] != ins.kk)
+			cpu.pc += 2;
+	}
+	// 5xy0 - SE Vx, Vy
+	void op_SE_reg(CPU& cpu, const Instruction& ins){
+		if (cpu.v[ins.x] == cpu.v[ins.y])
+			cpu.pc += 2;
+	}
+	// 6xkk - LD Vx, byte
+	void op_LD_byte(CPU& cpu, const Instruction& ins){
+		cpu.v[ins.x] = ins.kk;
+	}
+	// 7xkk - ADD Vx, byte
+	void op_ADD_byte(CPU& cpu, const Instruction& ins){
+		cpu.v[ins.x] += ins.kk;
+	}
+	// 8xy0 - LD Vx, Vy
+	void op_LD_reg(CPU& cpu, const Instruction& ins){
+		cpu.v[ins.x] = cpu.v[ins.y];
+	}
+	// 8xy1 - OR Vx, Vy
+	void op_OR(CPU& cpu, const Instruction& ins){
+		cpu.v[ins.x] |= cpu.v[ins.y];
+	}
+	// 8xy2 - AND Vx, Vy
+	void op_AND(CPU& cpu, const Instruction& ins){
+		cpu.v[ins.x] &= cpu.v[ins.y];
+	}
+	// 8xy3 - XOR Vx, Vy
+	void op_XOR(CPU& cpu, const Instruction& ins){
+		cpu.v[ins.x] ^= cpu.v[ins.y];
+	}
+	// 8xy4 - ADD Vx, Vy
+	void op_ADD_reg(CPU& cpu, const Instruction& ins){
+		uint8_t* v = cpu.v;
+		v[ins.x] += v[ins.y];
+		v[0xF] = (v[ins.y] > v[ins.x]) ? 1 : 0; // Carry flag
+	}
+	// 8xy5 - SUB Vx, Vy
+	void op_SUB(CPU& cpu, const Instruction& ins){
+		uint8_t* v = cpu.v;
+		v[0xF] = (v[ins.x] > v[ins.y]) ? 1 : 0;
+		v[ins.x] -= v[ins.y];
+	}
+	// 8xy6 - SHR Vx {, Vy}
+	void op_SHR(CPU& cpu, const Instruction& ins){
+		uint8_t* v = cpu.v;
+		v[0xF] = v[ins.x] & 1;
+		v[ins.x] >>= 1;
+	}
+	// 8xy7 - SUBN Vx, Vy
+	void op_SUBN(CPU& cpu, const Instruction& ins){
+		uint8_t* v = cpu.v;
+		v[0xF] = (v[ins.y] > v[ins.x]) ? 1 : 0;
+		v[ins.x] = v[ins.y] - v[ins.x];
+	}
+	// 8xyE - SHL Vx {, Vy}
+	void op_SHL(CPU& cpu, const Instruction& ins){
+		uint8_t* v = cpu.v;
+		v[0xF] = v[ins.x] >> MSB_POS;
+		v[ins.x] <<= 1;
+	}
+	// 9xy0 - SNE Vx, Vy
+	void op_SNE_reg(CPU& cpu, const Instruction& ins){
+		if (cpu.v[ins.x] != cpu.v[ins.y])
+			cpu.pc += 2;
+	}
+	// Annn - LD I, addr
+	void op_LD_I(CPU& cpu, const Instruction& ins){
+		cpu.i = ins.nnn;
+	}
+	// Bnnn - JP V0, addr
+	void op_JP_V0(CPU& cpu, const Instruction& ins){
+		cpu.pc = ins.nnn + cpu.v[0] - 2;
+	}
+	// Cxkk - RND Vx, byte
+	void op_RND(CPU& cpu, const Instruction& ins){
+		cpu.v[ins.x] = (cpu.random() % 0xFF) & ins.kk;
+	}
+	// Dxyn - DRW Vx, Vy, nibble
+	void op_DRW(CPU& cpu, const Instruction& ins){
+		cpu.draw(ins.x, ins.y, ins.n);
+	}
+	// Ex9E - SKP Vx
+	void op_SKP(CPU& cpu, const Instruction& ins){
+		if (cpu.chip8->keys[cpu.v[ins.x] & 0xF])
+			cpu.pc += 2;
+	}
+	// ExA1 - SKNP Vx
+	void op_SKNP(CPU& cpu, const Instruction& ins){
+		if (!cpu.chip8->keys[cpu.v[ins.x] & 0xF])
+			cpu.pc += 2;
+	}
+	// Fx07 - LD Vx, DT
+	void op_LD_Vx_DT(CPU& cpu, const Instruction& ins){
+		cpu.v[ins.x] = cpu.dt;
+	}
+	// Fx0A - LD Vx, K
+	void op_LD_Vx_K(CPU& cpu, const Instruction& ins){
+		cpu.wait_key(ins.x);
+	}
+	// Fx15 - LD DT, Vx
+	void op_LD_DT(CPU& cpu, const Instruction& ins){
+		cpu.dt = cpu.v[ins.x];
+	}
+	// Fx18 - LD ST, Vx
+	void op_LD_ST(CPU& cpu, const Instruction& ins){
+		cpu.st = cpu.v[ins.x];
+	}
+	// Fx1E - ADD I, Vx
+	void op_ADD_I(CPU& cpu, const Instruction& ins){
+		cpu.i += cpu.v[ins.x];
+	}
+	// Fx29 - LD F, Vx
+	void op_LD_F(CPU& cpu, const Instruction& ins){
+		cpu.i = cpu.v[ins.x] * 0x5;
+	}
+	// Fx30 - LD HF, Vx
+	void op_LD_HF(CPU& cpu, const Instruction& ins){
+		cpu.i = BIG_FONT_ADDR + (cpu.v[ins.x] & 0xF) * 10;
+	}
+	// Fx33 - LD B, Vx
+	void op_LD_B(CPU& cpu, const Instruction& ins){
+		uint8_t vx = cpu.v[ins.x];
+		cpu.mem[cpu.i & (MEM_SIZE - 1)] = vx / 100;
+		cpu.mem[(cpu.i+1) & (MEM_SIZE - 1)] = (vx / 10) % 10;
+		cpu.mem[(cpu.i+2) & (MEM_SIZE - 1)] = vx % 10;
+		cpu.invalidate(cpu.i, 3);
+	}
+	// Fx55 - LD [I], Vx
+	void op_LD_mem_Vx(CPU& cpu, const Instruction& ins){
+		for (uint8_t i = 0; i <= ins.x; i++)
+			cpu.mem[(cpu.i + i) & (MEM_SIZE - 1)] = cpu.v[i];
+		cpu.invalidate(cpu.i, ins.x + 1);
+	}
+	// Fx65 - LD Vx, [I]
+	void op_LD_Vx_mem(CPU& cpu, const Instruction& ins){
+		for (uint8_t i = 0; i <= ins.x; i++)
+			cpu.v[i] = cpu.mem[(cpu.i + i) & (MEM_SIZE - 1)];
+	}
+	// Fx75 - LD R, Vx
+	void op_LD_R(CPU& cpu, const Instruction& ins){
+		for (uint8_t i = 0; i <= ins.x; i++)
+			cpu.rpl[i] = cpu.v[i];
+	}
+	// Fx85 - LD Vx, R
+	void op_LD_Vx_R(CPU& cpu, const Instruction& ins){
+		for (uint8_t i = 0; i <= ins.x; i++)
+			cpu.v[i] = cpu.rpl[i];
+	}
+
+	// Same dispatch as decode() + execute(), but down to the exact opcode pattern
+	OpHandler select_handler(uint16_t opcode){
+		switch(opcode & 0xF000){
+			case 0x0000:
+				switch(opcode & 0x00FF){
+					case 0x00E0: return op_CLS;
+					case 0x00EE: return op_RET;
+					case 0x00FB: return op_SCR;
+					case 0x00FC: return op_SCL;
+					case 0x00FD: return op_EXIT;
+					case 0x00FE: return op_LOW;
+					case 0x00FF: return op_HIGH;
+					default: return ((opcode & 0x00F0) == 0x00C0) ? op_SCD : op_SYS;
+				}
+			case 0x1000: return op_JP;
+			case 0x2000: return op_CALL;
+			case 0x3000: return op_SE_byte;
+			case 0x4000: return op_SNE_byte;
+			case 0x5000: return op_SE_reg;
+			case 0x6000: return op_LD_byte;
+			case 0x7000: return op_ADD_byte;
+			case 0x8000:
+				switch(opcode & 0x000F){
+					case 0x0000: return op_LD_reg;
+					case 0x0001: return op_OR;
+					case 0x0002: return op_AND;
+					case 0x0003: return op_XOR;
+					case 0x0004: return op_ADD_reg;
+					case 0x0005: return op_SUB;
+					case 0x0006: return op_SHR;
+					case 0x0007: return op_SUBN;
+					case 0x000E: return op_SHL;
+					default: return op_ERR;
+				}
+			case 0x9000: return op_SNE_reg;
+			case 0xA000: return op_LD_I;
+			case 0xB000: return op_JP_V0;
+			case 0xC000: return op_RND;
+			case 0xD000: return op_DRW;
+			case 0xE000:
+				switch(opcode & 0x00FF){
+					case 0x009E: return op_SKP;
+					case 0x00A1: return op_SKNP;
+					default: return op_ERR;
+				}
+			case 0xF000:
+				switch(opcode & 0x00FF){
+					case 0x0007: return op_LD_Vx_DT;
+					case 0x000A: return op_LD_Vx_K;
+					case 0x0015: return op_LD_DT;
+					case 0x0018: return op_LD_ST;
+					case 0x001E: return op_ADD_I;
+					case 0x0029: return op_LD_F;
+					case 0x0030: return op_LD_HF;
+					case 0x0033: return op_LD_B;
+					case 0x0055: return op_LD_mem_Vx;
+					case 0x0065: return op_LD_Vx_mem;
+					case 0x0075: return op_LD_R;
+					case 0x0085: return op_LD_Vx_R;
+					default: return op_ERR;
+				}
+		}
+		return op_ERR;
+	}
+}
+
+void CPU::predecode(uint16_t addr){
+	addr &= (MEM_SIZE - 1);
+	Instruction& ins = icache[addr];
+	ins.opcode = mem[addr] << 8 | mem[(addr + 1) & (MEM_SIZE - 1)];
+	ins.x = Op::x(ins.opcode);
+	ins.y = Op::y(ins.opcode);
+	ins.kk = Op::kk(ins.opcode);
+	ins.nnn = Op::nnn(ins.opcode);
+	ins.n = Op::n(ins.opcode);
+	ins.handler = select_handler(ins.opcode);
+}
+
+void CPU::invalidate(uint16_t addr, uint16_t len){
+	// The instruction starting one byte before addr also overlaps it
+	for (uint32_t a = addr + MEM_SIZE - 1; a < (uint32_t)addr + MEM_SIZE + len; a++)
+		icache[a & (MEM_SIZE - 1)].handler = nullptr;
+	if (jit)
+		jit->invalidate(addr, len);
 }
+
+void CPU::flush_icache(){
+	for (int a = 0; a < MEM_SIZE; a++)
+		icache[a].handler = nullptr;
+	if (jit)
+		jit->flush();
+}
+
 /* debugging functions */
 void CPU::print_registers(){
 	printf("------------\n");
@@ -474,18 +833,3 @@ void CPU::print_registers(){
 	printf("------------\n");
 }
 
-void CPU::print_args(uint16_t opcode){
-	printf("------------\n");
-	printf("op: %s\n", Op::optostr(decode(opcode)));
-	size_t x = Op::x(opcode);
-	size_t y = Op::y(opcode);
-	uint8_t kk = Op::kk(opcode);
-	uint16_t nnn = Op::nnn(opcode);
-	uint8_t n = Op::n(opcode);
-	printf("x: 0x%02zX\n", x);
-	printf("y: 0x%02zX\n", y);
-	printf("kk: 0x%02X\n", kk);
-	printf("nnn: 0x%03X\n", nnn);
-	printf("n: 0x%01X\n", n);
-}
-
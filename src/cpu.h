@@ -3,40 +3,99 @@
 
 #include <chip8.h>
 #include <clock.h>
-#include <stack>
+
+class CPU;
+class Jit;
+class Profiler;
+class Tracer;
+struct Instruction;
+
+// Executes one predecoded instruction
+typedef void (*OpHandler)(CPU& cpu, const Instruction& ins);
+
+// An instruction with its handler picked and its operands already extracted (see CPU::predecode)
+struct Instruction {
+	OpHandler handler = nullptr; // nullptr if this entry still has to be decoded
+	uint16_t opcode = 0;
+	uint16_t nnn = 0;
+	uint8_t x = 0;
+	uint8_t y = 0;
+	uint8_t kk = 0;
+	uint8_t n = 0;
+};
 
 class CPU {
 	public:
-		std::stack<uint16_t> stack;
+		uint16_t stack[STACK_SIZE] = {0}; // Return addresses, used as a ring so a runaway CALL/RET can't leave it
+		uint8_t sp = 0; // Stack pointer, number of addresses pushed
 		Chip8* chip8;
-		Clock* clock;
+		Clock* clock = nullptr;
+		Jit* jit = nullptr; // Optional recompiler used by run(), the interpreter handles whatever it can't
+		Profiler* profiler = nullptr; // Optional execution counters, run() skips the JIT while profiling so nothing is missed
+		Tracer* tracer = nullptr; // Optional binary trace of every instruction, also skips the JIT
 		uint8_t v[NUM_VREGS] = {0}; // Vx registers
+		uint8_t rpl[NUM_RPL] = {0}; // SUPER-CHIP RPL user flags, Fx75/Fx85 copy the V registers to/from them
 		uint16_t i = 0x0; // 16-bit index register. Stores memory addresses
 		uint16_t pc = 0x200; // Program counter (set it to the beginning of ROM)
 		uint8_t dt = 0x0; // Delay timer
 		uint8_t st = 0x0; // 8-bit Sound timer
 		uint8_t *mem; // Points to the chip8's mem
 		uint16_t opcode = 0;
+		size_t invalid_opcodes = 0; // Number of invalid opcodes executed so far
+		uint32_t rng_state; // xorshift32 state used by Cxkk, never 0
+		uint64_t cycles = 0; // Instructions executed so far by run(), recordings use it to place key presses
+		// Fx0A waits by running again every cycle until a key is pressed and released, this is its state in between
+		bool key_wait = false; // Fx0A is waiting
+		uint16_t key_wait_held = 0; // Keys held as of its last run, one bit per key
+		uint16_t key_wait_pressed = 0; // Keys that went down since the wait started
 
 		// Constructors
-		CPU(Chip8* chip8) : chip8(chip8), mem(chip8->mem) {}
-		CPU(Chip8* chip8, Clock* clock) : chip8(chip8), clock(clock), mem(chip8->mem) {}
+		CPU(Chip8* chip8) : chip8(chip8), mem(chip8->mem), rng_state(time(0) | 1) {}
+		CPU(Chip8* chip8, Clock* clock) : chip8(chip8), clock(clock), mem(chip8->mem), rng_state(time(0) | 1) {}
 
 		// Fetches 2-byte (16-bit) instructions
 		void cycle();
-		// Counts down dt when it is non-zero
-		void delay_timer();
+		// Executes num_cycles instructions, through the JIT when there is one. Returns the number executed.
+		size_t run(size_t num_cycles);
+		// Counts dt and st down by one 60Hz tick, without sleeping
+		void tick_timers();
+		// Fx0A - LD Vx, K. Sets Vx once a key pressed during the wait is released, until then backs pc up so Fx0A runs
+		// again next cycle. Only looks at chip8->keys, so timers, drawing and input polling carry on while it waits.
+		void wait_key(uint8_t x);
+
+		// Next value from the CPU's own RNG
+		uint32_t random();
+		// Restart the RNG from a fixed seed so Cxkk gives the same numbers every run
+		void seed(uint32_t seed);
+		// Push/pop a return address
+		void push(uint16_t addr) { stack[sp++ % STACK_SIZE] = addr; }
+		uint16_t pop() { return stack[--sp % STACK_SIZE]; }
 
 		// Decode an opcode for so the CPU can understand it
 		uint8_t decode(uint16_t opcode);
 
-		// Execute CPU instruction
+		// Execute CPU instruction. The straightforward version of the cached handlers, cycle() doesn't use it but it's
+		// kept as the reference the handlers and the JIT are checked against.
 		void execute(uint8_t op);
+		// Fetch, decode() and execute() one instruction without the icache, the reference version of cycle()
+		void step();
+
+		// Decode the instruction at addr into the instruction cache
+		void predecode(uint16_t addr);
+		// Drop cached instructions overlapping mem[addr] to mem[addr+len-1], must be called whenever mem is written
+		void invalidate(uint16_t addr, uint16_t len);
+		// Drop every cached instruction (e.g. after loading a new ROM into mem)
+		void flush_icache();
+
+		// Dxyn, shared by execute() and the cached handlers
+		void draw(size_t x, size_t y, uint8_t n);
 			
 		/* debugging functions */
 		void print_registers();
-		void print_args(uint16_t opcode);
-		
+
+	private:
+		// Predecoded instructions indexed by address. Instructions can start on odd addresses, so every address gets an entry.
+		Instruction icache[MEM_SIZE];
 };
 
 #endif // CPU_H
@@ -1,47 +1,303 @@
 #include "dir_nav.h"
+#include <binio.h>
+#include <cctype>
+#include <set>
 
-unsigned int depth = 0;
+namespace fs = std::filesystem;
 
-std::string SelectGame(std::string games_directory){
-	std::vector<std::string> path_vect;
-	for (const auto & entry : std::filesystem::recursive_directory_iterator(games_directory)){
-		std::string entry_str = entry.path().string();
-		// Keep track of directories by appending a '/' to the end of its name
-		if (!std::filesystem::is_directory(entry))
-			path_vect.push_back(entry_str);
-		else {
-			sort(path_vect.begin(), path_vect.end());
-			path_vect.push_back(std::string(entry_str + "/"));
+namespace {
+	int64_t mtime_of(const fs::path& path, std::error_code& ec){
+		return fs::last_write_time(path, ec).time_since_epoch().count();
+	}
+
+	std::string join(const std::string& dir, const std::string& name){
+		return dir.empty() ? name : dir + "/" + name;
+	}
+
+	std::string parent_of(const std::string& path){
+		size_t slash = path.find_last_of('/');
+		return (slash == std::string::npos) ? "" : path.substr(0, slash);
+	}
+
+	std::string name_of(const std::string& path){
+		return path.substr(path.find_last_of('/') + 1);
+	}
+
+	std::string lower(std::string str){
+		std::transform(str.begin(), str.end(), str.begin(), ::tolower);
+		return str;
+	}
+
+	void write_string(Writer& w, const std::string& str){
+		w.varint(str.size());
+		w.bytes(str.data(), str.size());
+	}
+
+	std::string read_string(Reader& r){
+		std::string str(r.varint(), '\0');
+		if (r.has(str.size()))
+			r.bytes(&str[0], str.size());
+		return str;
+	}
+}
+
+bool RomLibrary::Open(const std::string& root){
+	this->root = root;
+	roms.clear();
+	dirs.clear();
+	dirs_listed = roms_hashed = 0;
+	std::error_code ec;
+	if (!fs::is_directory(root, ec)){
+		printf("\"%s\" is not a directory\n", root.c_str());
+		return false;
+	}
+	dirty = !Load();
+	Update("");
+	if (dirty)
+		Save();
+	return true;
+}
+
+std::string RomLibrary::FullPath(const RomEntry& rom) const {
+	return (fs::path(root) / fs::path(rom.path)).string();
+}
+
+std::vector<const RomEntry*> RomLibrary::Search(const std::string& text) const {
+	std::string needle = lower(text);
+	std::vector<const RomEntry*> found;
+	for (const auto& [path, rom] : roms)
+		if (lower(name_of(path)).find(needle) != std::string::npos)
+			found.push_back(&rom);
+	return found;
+}
+
+void RomLibrary::Refresh(RomEntry& rom){
+	std::error_code ec;
+	std::string full = FullPath(rom);
+	int64_t mtime = mtime_of(full, ec);
+	uint64_t size = fs::file_size(full, ec);
+	if (ec || (mtime == rom.mtime && size == rom.size))
+		return;
+	AddRom(rom.path, mtime, size);
+	Save();
+}
+
+void RomLibrary::Update(const std::string& dir){
+	std::error_code ec;
+	fs::path full = fs::path(root) / fs::path(dir);
+	int64_t mtime = mtime_of(full, ec);
+	if (ec){
+		RemoveDir(dir);
+		return;
+	}
+	auto known = dirs.find(dir);
+	if (known != dirs.end() && known->second.mtime == mtime){
+		// Nothing was added or removed here, but the subdirectories can still have changed
+		std::vector<std::string> subdirs = known->second.subdirs;
+		for (const std::string& subdir : subdirs)
+			Update(subdir);
+		return;
+	}
+
+	dirs_listed++;
+	dirty = true;
+	std::set<std::string> files;
+	std::vector<std::string> subdirs;
+	for (const auto& entry : fs::directory_iterator(full, ec)){
+		std::string name = entry.path().filename().string();
+		if (name[0] == '.') // Hidden, including the index itself
+			continue;
+		std::string path = join(dir, name);
+		std::error_code entry_ec;
+		if (entry.is_directory(entry_ec)){
+			subdirs.push_back(path);
+		} else if (entry.is_regular_file(entry_ec)){
+			files.insert(path);
+			int64_t file_mtime = mtime_of(entry.path(), entry_ec);
+			uint64_t size = entry.file_size(entry_ec);
+			auto rom = roms.find(path);
+			if (rom == roms.end() || rom->second.mtime != file_mtime || rom->second.size != size)
+				AddRom(path, file_mtime, size);
 		}
 	}
+	std::sort(subdirs.begin(), subdirs.end());
 
-	// Enumerate directories/files
-	int i = 1;
-	for (auto itr = path_vect.begin(); itr != path_vect.end(); itr++, i++){
-		// If  file
-		if (itr->substr(itr->length()-1) != "/") {
-			std::cout << i << ") " << itr->substr(itr->find_last_of("/")+1) << std::endl;	
-		} else {
-		// If a directory
-			std::transform(itr->begin(), itr->end(), itr->begin(), ::toupper);
-			std::cout << itr->substr(itr->substr(0, itr->size()-1).find_last_of("/")+1) << std::endl;
-			// Don't count directory
-			// i--; 
-			path_vect.erase(itr);
+	// Drop what's gone since the directory was last listed
+	for (auto rom = roms.begin(); rom != roms.end();){
+		if (parent_of(rom->first) == dir && !files.count(rom->first))
+			rom = roms.erase(rom);
+		else
+			rom++;
+	}
+	if (known != dirs.end())
+		for (const std::string& old : known->second.subdirs)
+			if (!std::binary_search(subdirs.begin(), subdirs.end(), old))
+				RemoveDir(old);
+
+	DirEntry& entry = dirs[dir];
+	entry.mtime = mtime;
+	entry.subdirs = subdirs;
+	for (const std::string& subdir : subdirs)
+		Update(subdir);
+}
+
+void RomLibrary::AddRom(const std::string& path, int64_t mtime, uint64_t size){
+	RomEntry& rom = roms[path];
+	rom.path = path;
+	rom.mtime = mtime;
+	rom.size = size;
+	rom.hash = HashFile(FullPath(rom).c_str());
+	roms_hashed++;
+	dirty = true;
+}
+
+void RomLibrary::RemoveDir(const std::string& dir){
+	auto known = dirs.find(dir);
+	if (known == dirs.end())
+		return;
+	std::vector<std::string> subdirs = known->second.subdirs;
+	dirs.erase(known);
+	for (auto rom = roms.begin(); rom != roms.end();){
+		if (parent_of(rom->first) == dir)
+			rom = roms.erase(rom);
+		else
+			rom++;
+	}
+	for (const std::string& subdir : subdirs)
+		RemoveDir(subdir);
+	dirty = true;
+}
+
+/* Index layout after the magic and version, all counts and string lengths are varints:
+ *   directories: count, then path, u64 mtime, subdirectory count and their paths
+ *   ROMs: count, then path, u64 mtime, size, u64 hash */
+bool RomLibrary::Save(){
+	Writer w;
+	w.bytes(LIBRARY_MAGIC, 4);
+	w.u16(LIBRARY_VERSION);
+	w.varint(dirs.size());
+	for (const auto& [path, dir] : dirs){
+		write_string(w, path);
+		w.u64(dir.mtime);
+		w.varint(dir.subdirs.size());
+		for (const std::string& subdir : dir.subdirs)
+			write_string(w, subdir);
+	}
+	w.varint(roms.size());
+	for (const auto& [path, rom] : roms){
+		write_string(w, path);
+		w.u64(rom.mtime);
+		w.varint(rom.size);
+		w.u64(rom.hash);
+	}
+	// Not being able to save only means the next launch has to scan again
+	dirty = !WriteFile((fs::path(root) / LIBRARY_INDEX).string().c_str(), w.buf);
+	if (!dirty && dirs.count("")){
+		// Writing the index touched the root's mtime, which would have it listed again next time for nothing
+		std::error_code ec;
+		int64_t mtime = mtime_of(root, ec);
+		if (!ec && mtime != dirs[""].mtime){
+			dirs[""].mtime = mtime;
+			return Save();
+		}
+	}
+	return !dirty;
+}
+
+bool RomLibrary::Load(){
+	std::string path = (fs::path(root) / LIBRARY_INDEX).string();
+	std::error_code ec;
+	std::vector<uint8_t> buf;
+	if (!fs::exists(path, ec) || !ReadFile(path.c_str(), buf))
+		return false;
+
+	Reader r = {buf.data(), buf.data() + buf.size()};
+	char magic[4];
+	r.bytes(magic, 4);
+	if (!r.ok || memcmp(magic, LIBRARY_MAGIC, 4) || r.u16() != LIBRARY_VERSION)
+		return false;
+	for (uint64_t n = r.varint(); n && r.ok; n--){
+		std::string dir = read_string(r);
+		DirEntry& entry = dirs[dir];
+		entry.mtime = r.u64();
+		for (uint64_t k = r.varint(); k && r.ok; k--)
+			entry.subdirs.push_back(read_string(r));
+	}
+	for (uint64_t n = r.varint(); n && r.ok; n--){
+		RomEntry rom;
+		rom.path = read_string(r);
+		rom.mtime = r.u64();
+		rom.size = r.varint();
+		rom.hash = r.u64();
+		roms[rom.path] = rom;
+	}
+	if (!r.ok || !r.done()){
+		// Start over rather than trust half an index
+		printf("Library index \"%s\" is damaged, rescanning\n", path.c_str());
+		roms.clear();
+		dirs.clear();
+		return false;
+	}
+	return true;
+}
+
+namespace {
+	// Numbered list of ROMs, with a header whenever the directory changes
+	void print_roms(const std::vector<const RomEntry*>& list){
+		std::string dir = "\x01";
+		for (size_t i = 0; i < list.size(); i++){
+			std::string rom_dir = parent_of(list[i]->path);
+			if (rom_dir != dir){
+				dir = rom_dir;
+				std::string header = dir + "/";
+				std::transform(header.begin(), header.end(), header.begin(), ::toupper);
+				std::cout << header << std::endl;
+			}
+			std::cout << i + 1 << ") " << name_of(list[i]->path) << std::endl;
 		}
 	}
+}
 
-	size_t num_games = path_vect.size();
-	int input_selection = 0;
-	while (input_selection < 1 || input_selection > num_games){
-		std::cout << "Enter a number to select a game: " << std::endl;
-		std::cin >> input_selection;
+std::string SelectGame(std::string games_directory){
+	RomLibrary library;
+	if (!library.Open(games_directory))
+		return "";
+	std::vector<const RomEntry*> list = library.Search("");
+	if (list.empty()){
+		printf("No ROMs found in \"%s\"\n", games_directory.c_str());
+		return "";
 	}
-	return path_vect[input_selection-1];
+	print_roms(list);
+
+	// A number picks from the list, anything else searches the whole library by name
+	std::string line;
+	while (true){
+		std::cout << "Enter a number to select a game, or part of its name to search: " << std::endl;
+		if (!std::getline(std::cin, line))
+			return "";
+		char* end;
+		unsigned long selection = std::strtoul(line.c_str(), &end, 10);
+		if (!line.empty() && *end == '\0'){
+			if (selection >= 1 && selection <= list.size())
+				break;
+			continue;
+		}
+		std::vector<const RomEntry*> found = library.Search(line);
+		if (found.empty()){
+			std::cout << "No ROMs match \"" << line << "\"" << std::endl;
+			continue;
+		}
+		list = found;
+		print_roms(list);
+	}
+
+	RomEntry& rom = library.roms[list[std::strtoul(line.c_str(), NULL, 10) - 1]->path];
+	library.Refresh(rom);
+	return library.FullPath(rom);
 }
 
 void SaveLastGamePlayed(std::string filename){
-	std::fstream fstr;	
+	std::fstream fstr;
 	fstr.open(filename, std::fstream::in | std::fstream::out | std::fstream::app);
 	fstr.close();
 }
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <vector>
 #include <list>
+#include <map>
 #include <filesystem>
 #include <fstream>
 #include <algorithm>
@@ -16,6 +17,59 @@
 #define DIR_SEP "/"
 #endif // _WIN32
 
+// The library index is saved inside the games directory under this name
+#define LIBRARY_INDEX ".chip8-library"
+// Index files start with this, followed by the format version
+#define LIBRARY_MAGIC "C8LB"
+#define LIBRARY_VERSION 1
+
+// One ROM in the library. Paths are relative to the library root and always use '/'.
+struct RomEntry {
+	std::string path;
+	int64_t mtime = 0; // Last write time when it was hashed
+	uint64_t size = 0;
+	uint64_t hash = 0; // HashFile of the contents
+};
+
+/* Index of every ROM under a games directory, saved between launches
+ * Only what changed since the last launch is looked at again: a directory is listed again only when its mtime changed
+ * (a file in it was added, removed or renamed), and a ROM is hashed again only when its mtime or size changed. A ROM
+ * edited in place doesn't change its directory's mtime, Refresh() catches that when it's picked. */
+class RomLibrary {
+public:
+	std::string root;
+	std::map<std::string, RomEntry> roms; // By path, so ROMs in the same directory are next to each other
+	size_t dirs_listed = 0; // Directories listed and ROMs hashed by the last Open(), the rest came from the index
+	size_t roms_hashed = 0;
+
+	// Load the saved index for root and bring it up to date with what's on disk, saving it again if anything changed.
+	// Returns false if root can't be read.
+	bool Open(const std::string& root);
+	// Full path of a ROM, for opening it
+	std::string FullPath(const RomEntry& rom) const;
+	// ROMs whose file name contains text, ignoring case. Empty text matches everything.
+	std::vector<const RomEntry*> Search(const std::string& text) const;
+	// Hash a ROM again if it changed since it was indexed
+	void Refresh(RomEntry& rom);
+	bool Save();
+
+private:
+	struct DirEntry {
+		int64_t mtime = 0;
+		std::vector<std::string> subdirs;
+	};
+	std::map<std::string, DirEntry> dirs; // By path, "" is the root
+	bool dirty = false;
+
+	bool Load();
+	// Bring a directory and everything below it up to date
+	void Update(const std::string& dir);
+	void AddRom(const std::string& path, int64_t mtime, uint64_t size);
+	// Forget a directory and everything below it
+	void RemoveDir(const std::string& dir);
+};
+
+// Lists the ROMs under games_directory and asks which one to run, returns "" if there are none
 std::string SelectGame(std::string games_directory);
 
 #endif // DIR_NAV_H
@@ -2,67 +2,74 @@
 #include <display.h>
 #include <cpu.h>
 
-SDL_Rect Display::GetPixel(uint8_t x, uint8_t y){
-	// Create a 10x10 rectangle (the pixel)
-    SDL_Rect pixel;
-    pixel.x = x * PIXEL_SIZE;
-    pixel.y = y * PIXEL_SIZE;
-
-    pixel.w = PIXEL_SIZE;
-    pixel.h = PIXEL_SIZE;
-	return pixel;
+void ExitChip8(){
+	printf("Exiting... Goodbye!\n");
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+	exit(EXIT_SUCCESS);
 }
 
-void Display::RenderGFX(size_t* num_pixels, SDL_Renderer *renderer){
-	uint16_t x_pos = 1;
-	uint16_t y_pos = 1;
-	std::vector<SDL_Rect> set_vect;
-	std::vector<SDL_Rect> unset_vect;
-	if (chip8->draw_flag){
-		chip8->draw_flag = false;
-		for (int i = 0; i < DISP_X*DISP_Y; i++, x_pos++){
-			if (chip8->gfx[i])
-				set_vect.push_back(GetPixel(x_pos, y_pos));
-			else
-				unset_vect.push_back(GetPixel(x_pos, y_pos));
+Display::Display(Chip8* chip8, SDL_Renderer* renderer) : chip8(chip8), renderer(renderer) {
+	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, HIRES_X, HIRES_Y);
+	if (!texture)
+		printf("Error creating texture: %s\n", SDL_GetError());
+}
 
-			if (((i+1) % DISP_X) == 0){
-				y_pos++;
-				x_pos = 0;
-			}
-		}
+Display::~Display(){
+	if (texture)
+		SDL_DestroyTexture(texture);
+}
 
-		// Display graphics into terminal
-		if (VERBOSE_DISPLAY){
-			for (int i = 0; i < DISP_X*DISP_Y; i++){
-				if (chip8->gfx[i]) {
-					printf("%s", PX);
-				} else {
-					printf("  ");
-				}
-				if (((i+1) % DISP_X) == 0) {
-					printf("\n");
-				}
-			}
+void Display::UploadGFX(const uint64_t (*gfx)[GFX_WORDS], int width, int height){
+	void* pixels;
+	int pitch;
+	// Only the top-left corner of the texture is used in low resolution, so that's all that gets uploaded
+	SDL_Rect area = {0, 0, width, height};
+	if (SDL_LockTexture(texture, &area, &pixels, &pitch)){
+		printf("Error locking texture: %s\n", SDL_GetError());
+		return;
+	}
+	for (int y = 0; y < height; y++){
+		uint32_t* line = (uint32_t*) ((uint8_t*) pixels + y * pitch);
+		for (int word = 0; word < width / 64; word++){
+			uint64_t bits = gfx[y][word];
+			for (int x = 0; x < 64; x++)
+				line[word * 64 + x] = ((bits >> (63 - x)) & 1) ? PIXEL_ON : PIXEL_OFF;
 		}
 	}
+	SDL_UnlockTexture(texture);
+}
 
-	SDL_Rect set_arr[set_vect.size()];
-	std::copy(set_vect.begin(), set_vect.end(), set_arr);
-
-	SDL_Rect unset_arr[unset_vect.size()];
-	std::copy(unset_vect.begin(), unset_vect.end(), unset_arr);
+void Display::Draw(const uint64_t (*gfx)[GFX_WORDS], bool hires){
+	int width = hires ? HIRES_X : DISP_X;
+	int height = hires ? HIRES_Y : DISP_Y;
 
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-	RenderPixels(renderer, set_arr, set_vect.size());
+	if (terminal)
+		terminal->Draw(gfx, hires);
 
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-	RenderPixels(renderer, unset_arr, unset_vect.size());
-    SDL_RenderPresent(renderer);
+	UploadGFX(gfx, width, height);
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+	SDL_RenderClear(renderer);
+	// Either resolution is scaled to the same window area
+	SDL_Rect src = {0, 0, width, height};
+	SDL_RenderCopy(renderer, texture, &src, &dest);
+	SDL_RenderPresent(renderer);
 }
 
-void Display::RenderPixels(SDL_Renderer* renderer, SDL_Rect* pixel_arr, size_t num_pixels){
-	SDL_RenderFillRects(renderer, pixel_arr, num_pixels);
+void Display::RenderGFX(){
+	if (!chip8->draw_flag){
+		if (terminal)
+			terminal->Flush();
+		return;
+	}
+	chip8->draw_flag = false;
+	Draw(chip8->gfx, chip8->hires);
 }
 
+void Display::RenderFrame(const Frame& frame){
+	Draw(frame.gfx, frame.hires);
+}
 
+void Display::Present(){
+	RenderGFX();
+}
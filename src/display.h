@@ -1,32 +1,58 @@
 #ifndef DISPLAY_H
 #define DISPLAY_H
 
-// A black square to draw on the terminal
-#define PX "\u2588\u2588"
-
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL_timer.h>
 
 #include <chip8.h>
 #include <cpu.h>
+#include <io.h>
+#include <frame.h>
+#include <terminal.h>
 
 #define SCREEN_X 1320
 #define SCREEN_Y 680
 
 #define PIXEL_SIZE 20
 
+// ARGB8888 colors of lit and unlit pixels
+#define PIXEL_ON 0xFFFFFFFF
+#define PIXEL_OFF 0xFF000000
+
 extern SDL_Window* window;
 
-class Display {
+// Destroy SDL and exit
+void ExitChip8();
+
+/* Renders the framebuffer through a HIRES_X by HIRES_Y streaming texture
+ * Each frame is a single texture upload that the renderer scales up to the window. In low resolution only the
+ * top-left DISP_X by DISP_Y corner is uploaded and scaled, so the larger texture costs nothing extra per frame.
+ * RenderGFX draws straight from the chip8 (only if it drew something since the last frame), RenderFrame draws a Frame
+ * the emulation thread handed over. Either way it has to be called from the thread that owns the renderer. */
+class Display : public OutputSink {
 public:
 	Chip8* chip8;
-
-	Display(Chip8* chip8) : chip8(chip8) {}
-  
-	SDL_Rect GetPixel(uint8_t x, uint8_t y);
-	void RenderGFX(size_t* num_pixels, SDL_Renderer *renderer);
-	void RenderPixels(SDL_Renderer* renderer, SDL_Rect* pixel_arr, size_t num_pixels);
+	SDL_Renderer* renderer;
+	TerminalOutput* terminal = nullptr; // Every frame shown is drawn here as well when set (-v display)
+
+	Display(Chip8* chip8, SDL_Renderer* renderer);
+	~Display();
+
+	// Upload and present the framebuffer if draw_flag is set
+	void RenderGFX();
+	// Upload and present a captured frame
+	void RenderFrame(const Frame& frame);
+	// OutputSink
+	void Present() override;
+private:
+	SDL_Texture* texture;
+	// Where the texture goes in the window, leaving a one chip8 pixel border
+	SDL_Rect dest = {PIXEL_SIZE, PIXEL_SIZE, DISP_X * PIXEL_SIZE, DISP_Y * PIXEL_SIZE};
+
+	// Expand the packed framebuffer rows into texture pixels
+	void UploadGFX(const uint64_t (*gfx)[GFX_WORDS], int width, int height);
+	void Draw(const uint64_t (*gfx)[GFX_WORDS], bool hires);
 };
 
 #endif // DISPLAY_H
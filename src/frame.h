@@ -0,0 +1,53 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <chip8.h>
+#include <atomic>
+#include <cstring>
+
+// A finished frame, copied out of the chip8 so it can be shown while the next one is being emulated
+struct Frame {
+	uint64_t gfx[HIRES_Y][GFX_WORDS];
+	bool hires;
+	uint64_t number; // Scheduler frame it was taken on
+
+	void Capture(const Chip8* chip8, uint64_t number){
+		memcpy(gfx, chip8->gfx, sizeof(gfx));
+		hires = chip8->hires;
+		this->number = number;
+	}
+};
+
+/* Lock-free handoff of the latest value from one producer thread to one consumer thread
+ * There are three slots: the producer fills the back one, the consumer reads the front one, and the one in the middle
+ * holds the latest published value. Publish swaps back with the middle and Acquire swaps the middle with front, each a
+ * single atomic exchange, so neither side ever waits for the other. Values the consumer didn't get to in time are
+ * overwritten by newer ones. */
+template<typename T>
+class TripleBuffer {
+public:
+	// Producer side
+	T& Back() { return slots[back]; }
+	void Publish(){
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// Consumer side. If something was published since the last call, makes it Front() and returns true.
+	bool Acquire(){
+		if (!(middle.load(std::memory_order_relaxed) & FRESH))
+			return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+	const T& Front() const { return slots[front]; }
+
+private:
+	static constexpr uint8_t INDEX = 0x3;
+	static constexpr uint8_t FRESH = 0x4; // Set in middle when it holds a value the consumer hasn't taken yet
+	T slots[3];
+	uint8_t back = 0; // Only touched by the producer
+	uint8_t front = 1; // Only touched by the consumer
+	std::atomic<uint8_t> middle{2};
+};
+
+#endif // FRAME_H
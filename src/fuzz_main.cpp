@@ -0,0 +1,479 @@
+// chip8-fuzz: runs random and mutated programs through every execution engine, checking invariants and that they agree
+#include <chip8.h>
+#include <cpu.h>
+#include <jit.h>
+#include <thread_pool.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// For parsing CLI args
+#include <getopt.h>
+
+#define DEFAULT_RUNS 100000
+#define DEFAULT_STEPS 1024
+#define DEFAULT_OUT_DIR "fuzz-failures"
+// Instructions between timer ticks and key changes, the JIT is compared at the same boundaries
+#define FUZZ_BATCH 16
+// Runs handed to a worker at a time
+#define FUZZ_CHUNK 256
+// Only this many failures are printed, the rest are just counted and saved
+#define MAX_PRINTED_FAILURES 20
+/* The CPU's memory is put in a page of its own with this much inaccessible memory on either side, so any access outside
+ * mem faults instead of quietly landing in whatever follows it. I goes up to 0xFFFF and Fx55/Fx65 add up to 15 to it,
+ * which is as far past mem as an address can get. */
+#define GUARD_SIZE 0x11000
+
+size_t num_steps = DEFAULT_STEPS;
+bool use_jit = true;
+const char* out_dir = DEFAULT_OUT_DIR;
+uint64_t base_seed = 0;
+std::vector<std::vector<uint8_t>> corpus; // ROMs to mutate
+
+void help_menu(){
+	printf("Usage: chip8-fuzz [options] [corpus_directory]\n"
+			"Runs random programs, and mutations of the ROMs under corpus_directory, through the cached interpreter\n"
+			"(cycle), the reference interpreter (decode/execute) and the JIT. Each run checks that pc stays in memory,\n"
+			"that no instruction touches memory outside the chip8's 4K, that SKP/SKNP look at the key Vx names, and that\n"
+			"all engines end in the same state. Failing programs are saved as ROMs.\n"
+			"Options:\n"
+			"-n, --runs <n>\t\t\tPrograms to run, 0 for no limit (default %d)\n"
+			"-s, --steps <n>\t\t\tInstructions per program (default %d)\n"
+			"-d, --duration <seconds>\tStop after this long\n"
+			"-t, --threads <n>\t\tWorker threads (default: one per core)\n"
+			"-o, --out <dir>\t\t\tWhere failing programs are saved (default %s)\n"
+			"    --seed <n>\t\t\tSeed for the whole campaign (random by default)\n"
+			"    --run <n>\t\t\tOnly redo run n of the campaign given by --seed, saving its program first\n"
+			"    --no-jit\t\t\tDon't compare against the JIT\n"
+			"-h, --help\t\t\tThis help menu\n", DEFAULT_RUNS, DEFAULT_STEPS, DEFAULT_OUT_DIR);
+}
+
+// splitmix64, every run gets its own stream so any run can be redone from the campaign seed and its number
+struct Rng {
+	uint64_t state;
+
+	uint64_t next(){
+		uint64_t z = (state += 0x9E3779B97F4A7C15);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+		return z ^ (z >> 31);
+	}
+	uint32_t below(uint32_t n) { return next() % n; }
+};
+
+Rng RunRng(uint64_t run){
+	Rng rng = {base_seed ^ (run * 0xD1B54A32D192ED03)};
+	rng.next();
+	return rng;
+}
+
+// An opcode picked to hit the edge cases: I near the top of its range, returns with nothing on the stack, skips on
+// keys past F, jumps that land past the end of memory, and so on. Jumps and calls go into the program so it loops.
+uint16_t RandomOpcode(Rng& rng, uint16_t start, uint16_t len){
+	uint16_t r = rng.next();
+	uint16_t x = r & 0x0F00;
+	switch (rng.below(16)){
+		case 0: return r; // Anything, invalid opcodes included
+		case 1: return 0x00EE;
+		case 2: {
+			const uint16_t schip[] = {0x00E0, 0x00FB, 0x00FC, 0x00FE, 0x00FF, (uint16_t)(0x00C0 | (r & 0xF))};
+			return schip[rng.below(6)];
+		}
+		case 3: return (rng.below(2) ? 0x1000 : 0x2000) | ((start + 2 * rng.below(len)) & 0xFFF);
+		case 4: return 0xAF00 | (r & 0xFF);
+		case 5: return 0xF01E | x;
+		case 6: {
+			const uint16_t mem_ops[] = {0xF033, 0xF055, 0xF065};
+			return mem_ops[rng.below(3)] | x;
+		}
+		case 7: return (rng.below(2) ? 0xE09E : 0xE0A1) | x;
+		case 8: return 0xD000 | (r & 0x0FFF);
+		case 9: return 0xB000 | (r & 0x0FFF);
+		case 10: return 0xF00A | x;
+		case 11: {
+			const uint16_t f_ops[] = {0xF007, 0xF015, 0xF018, 0xF029, 0xF030, 0xF075, 0xF085};
+			return f_ops[rng.below(7)] | x;
+		}
+		default: {
+			// Arithmetic, compares and loads
+			const uint8_t groups[] = {0x3, 0x4, 0x5, 0x6, 0x7, 0x8, 0x9, 0xC};
+			return (groups[rng.below(8)] << 12) | (r & 0x0FFF);
+		}
+	}
+}
+
+// The program for a run, loaded at ROM_START
+std::vector<uint8_t> MakeProgram(Rng& rng){
+	const size_t max_len = MEM_SIZE - ROM_START;
+	std::vector<uint8_t> program;
+	if (corpus.empty() || rng.below(2)){
+		uint16_t len = 1 + rng.below(128);
+		for (uint16_t k = 0; k < len; k++){
+			uint16_t opcode = RandomOpcode(rng, ROM_START, len);
+			program.push_back(opcode >> 8);
+			program.push_back(opcode & 0xFF);
+		}
+		return program;
+	}
+
+	program = corpus[rng.below(corpus.size())];
+	if (program.empty())
+		program.push_back(0);
+	for (uint32_t m = 1 + rng.below(8); m; m--){
+		size_t at = rng.below(program.size());
+		switch (rng.below(4)){
+			case 0: // Flip a bit
+				program[at] ^= 1 << rng.below(8);
+				break;
+			case 1: // Random byte
+				program[at] = rng.next();
+				break;
+			case 2: { // Replace an instruction
+				at &= ~(size_t)1;
+				uint16_t opcode = RandomOpcode(rng, ROM_START, program.size() / 2 + 1);
+				program[at] = opcode >> 8;
+				if (at + 1 < program.size())
+					program[at + 1] = opcode & 0xFF;
+				break;
+			}
+			case 3: { // Repeat a chunk somewhere else
+				size_t len = 1 + rng.below(16);
+				size_t from = rng.below(program.size());
+				std::vector<uint8_t> chunk(program.begin() + from, program.begin() + std::min(from + len, program.size()));
+				program.insert(program.begin() + at, chunk.begin(), chunk.end());
+				break;
+			}
+		}
+	}
+	program.resize(std::min(program.size(), max_len));
+	return program;
+}
+
+// Run being executed by this thread, for the fault handler
+thread_local uint64_t current_run = 0;
+
+void FaultHandler(int sig){
+	char msg[160];
+	int len = snprintf(msg, sizeof(msg), "Run %llu accessed memory outside the chip8's 4K (signal %d), "
+			"redo it with --seed %llu --run %llu\n", (unsigned long long) current_run, sig,
+			(unsigned long long) base_seed, (unsigned long long) current_run);
+	if (write(STDERR_FILENO, msg, len) < 0) {}
+	_exit(2);
+}
+
+// A Chip8 and CPU whose memory sits between guard regions
+struct Machine {
+	std::unique_ptr<Chip8> chip8;
+	std::unique_ptr<CPU> cpu;
+	uint8_t* region = nullptr;
+
+	Machine() : chip8(new Chip8), cpu(new CPU(chip8.get())) {
+		size_t size = GUARD_SIZE + MEM_SIZE + GUARD_SIZE;
+		void* mapped = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapped == MAP_FAILED || mprotect((uint8_t*) mapped + GUARD_SIZE, MEM_SIZE, PROT_READ | PROT_WRITE)){
+			perror("Can't map guarded memory");
+			exit(1);
+		}
+		region = (uint8_t*) mapped;
+		cpu->mem = region + GUARD_SIZE;
+	}
+	~Machine(){
+		munmap(region, GUARD_SIZE + MEM_SIZE + GUARD_SIZE);
+	}
+
+	// Start a run from power on with the font and program in memory. Everything the CPU carries between instructions
+	// has to be reset here.
+	void Reset(const uint8_t* image, uint32_t seed){
+		memcpy(cpu->mem, image, MEM_SIZE);
+		chip8->ClearScreen();
+		chip8->hires = false;
+		chip8->draw_flag = false;
+		memset(chip8->keys, 0, sizeof(chip8->keys));
+		CPU& c = *cpu;
+		memset(c.v, 0, sizeof(c.v));
+		memset(c.rpl, 0, sizeof(c.rpl));
+		memset(c.stack, 0, sizeof(c.stack));
+		c.sp = 0;
+		c.i = 0;
+		c.pc = ROM_START;
+		c.dt = c.st = 0;
+		c.cycles = 0;
+		c.invalid_opcodes = 0;
+		c.key_wait = false;
+		c.key_wait_held = c.key_wait_pressed = 0;
+		c.seed(seed);
+		c.flush_icache();
+	}
+};
+
+// Name of the first thing two machines disagree on, NULL if they don't
+const char* Difference(const Machine& a, const Machine& b){
+	const CPU& x = *a.cpu;
+	const CPU& y = *b.cpu;
+	if (x.pc != y.pc) return "pc";
+	if (memcmp(x.v, y.v, sizeof(x.v))) return "V registers";
+	if (x.i != y.i) return "I";
+	if (x.sp != y.sp || memcmp(x.stack, y.stack, sizeof(x.stack))) return "stack";
+	if (x.dt != y.dt || x.st != y.st) return "timers";
+	if (memcmp(x.rpl, y.rpl, sizeof(x.rpl))) return "RPL flags";
+	if (x.rng_state != y.rng_state) return "RNG";
+	if (x.key_wait != y.key_wait || x.key_wait_held != y.key_wait_held || x.key_wait_pressed != y.key_wait_pressed)
+		return "Fx0A wait";
+	if (memcmp(x.mem, y.mem, MEM_SIZE)) return "memory";
+	if (a.chip8->hires != b.chip8->hires || memcmp(a.chip8->gfx, b.chip8->gfx, sizeof(a.chip8->gfx))) return "screen";
+	return NULL;
+}
+
+struct Stats {
+	std::atomic<uint64_t> runs{0};
+	std::atomic<uint64_t> instructions{0};
+	std::atomic<uint64_t> failures{0};
+	std::mutex print_lock;
+};
+
+// Everything one worker needs, reused from run to run
+struct Worker {
+	Machine cached; // cycle()
+	Machine reference; // step()
+	Machine jitted; // run() through the JIT
+	Jit jit;
+	uint8_t image[MEM_SIZE];
+
+	Worker(){
+		memcpy(image, cached.chip8->mem, MEM_SIZE); // Power on memory, i.e. just the fonts
+		if (use_jit && jit.available())
+			jitted.cpu->jit = &jit;
+	}
+
+	// Returns what went wrong, NULL if nothing did
+	const char* Run(const std::vector<uint8_t>& program, Rng& rng){
+		memset(image + ROM_START, 0, MEM_SIZE - ROM_START);
+		memcpy(image + ROM_START, program.data(), program.size());
+		uint32_t seed = rng.next();
+		cached.Reset(image, seed);
+		reference.Reset(image, seed);
+		bool with_jit = jitted.cpu->jit;
+		if (with_jit){
+			jitted.Reset(image, seed);
+			jit.flush();
+		}
+
+		CPU& a = *cached.cpu;
+		CPU& b = *reference.cpu;
+		for (size_t done = 0; done < num_steps; done += FUZZ_BATCH){
+			for (int k = 0; k < FUZZ_BATCH; k++){
+				uint16_t opcode = a.mem[a.pc] << 8 | a.mem[(a.pc + 1) & (MEM_SIZE - 1)];
+				uint16_t next_pc = (a.pc + 2) & (MEM_SIZE - 1);
+				// SKP/SKNP only look at the low nibble of Vx, whatever else is in it
+				bool skp = (opcode & 0xF0FF) == 0xE09E;
+				bool sknp = (opcode & 0xF0FF) == 0xE0A1;
+				bool pressed = cached.chip8->keys[a.v[Op::x(opcode)] & 0xF];
+				a.cycle();
+				b.step();
+				if (a.pc >= MEM_SIZE || b.pc >= MEM_SIZE)
+					return "pc left memory";
+				if ((skp && a.pc != ((next_pc + 2 * pressed) & (MEM_SIZE - 1)))
+						|| (sknp && a.pc != ((next_pc + 2 * !pressed) & (MEM_SIZE - 1))))
+					return "SKP/SKNP checked the wrong key";
+			}
+			if (with_jit){
+				jitted.cpu->run(FUZZ_BATCH);
+				if (jitted.cpu->pc >= MEM_SIZE)
+					return "pc left memory (JIT)";
+			}
+
+			// Same 60Hz tick and key changes for everyone
+			bool keys_change = rng.below(4) == 0;
+			uint16_t keys = rng.next();
+			for (Machine* m : {&cached, &reference, &jitted}){
+				m->cpu->tick_timers();
+				if (keys_change)
+					for (int key = 0; key < NUM_KEYS; key++)
+						m->chip8->keys[key] = (keys >> key) & 1;
+			}
+		}
+		if (Difference(cached, reference))
+			return Difference(cached, reference);
+		if (with_jit && Difference(cached, jitted))
+			return "JIT disagrees with the interpreter";
+		return NULL;
+	}
+};
+
+std::string SaveProgram(uint64_t run, const std::vector<uint8_t>& program){
+	std::error_code ec;
+	std::filesystem::create_directories(out_dir, ec);
+	std::string path = (std::filesystem::path(out_dir) / (std::to_string(base_seed) + "-" + std::to_string(run) + ".ch8"))
+		.string();
+	std::ofstream file(path, std::ios::binary);
+	file.write((const char*) program.data(), program.size());
+	return file ? path : "(couldn't save it)";
+}
+
+// Runs [first, first + count), stopping early at the deadline
+void RunChunk(uint64_t first, uint64_t count, std::chrono::steady_clock::time_point deadline, Stats* stats){
+	thread_local std::unique_ptr<Worker> worker;
+	if (!worker)
+		worker.reset(new Worker);
+	for (uint64_t run = first; run < first + count; run++){
+		if (std::chrono::steady_clock::now() > deadline)
+			return;
+		current_run = run;
+		Rng rng = RunRng(run);
+		std::vector<uint8_t> program = MakeProgram(rng);
+		const char* failure = worker->Run(program, rng);
+		stats->runs++;
+		stats->instructions += num_steps;
+		if (!failure)
+			continue;
+		uint64_t n = ++stats->failures;
+		std::string path = SaveProgram(run, program);
+		if (n <= MAX_PRINTED_FAILURES){
+			std::lock_guard<std::mutex> lock(stats->print_lock);
+			printf("Run %llu: %s, program saved to %s\n", (unsigned long long) run, failure, path.c_str());
+			fflush(stdout);
+		}
+	}
+}
+
+void LoadCorpus(const char* dir){
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::recursive_directory_iterator(dir, ec)){
+		if (!entry.is_regular_file() || entry.path().filename().string()[0] == '.')
+			continue;
+		std::ifstream file(entry.path(), std::ios::binary);
+		std::vector<uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (!rom.empty() && rom.size() <= MEM_SIZE - ROM_START)
+			corpus.push_back(rom);
+	}
+	if (ec)
+		printf("Couldn't read corpus \"%s\": %s\n", dir, ec.message().c_str());
+}
+
+int main(int argc, char *argv[]){
+	uint64_t num_runs = DEFAULT_RUNS;
+	double duration = 0;
+	size_t num_threads = 0;
+	bool seeded = false;
+	bool single_run = false;
+	uint64_t only_run = 0;
+	int o;
+	int opt_index = 0;
+
+	const struct option long_opts[] =
+	{
+		{"runs", required_argument, 0, 'n'},
+		{"steps", required_argument, 0, 's'},
+		{"duration", required_argument, 0, 'd'},
+		{"threads", required_argument, 0, 't'},
+		{"out", required_argument, 0, 'o'},
+		{"seed", required_argument, 0, 'e'},
+		{"run", required_argument, 0, 'r'},
+		{"no-jit", no_argument, 0, 'J'},
+		{"help",   no_argument,  0, 'h'},
+		{0,0,0,0},
+	};
+
+	while ((o = getopt_long(argc, argv, "hn:s:d:t:o:", long_opts, &opt_index)) != -1){
+		switch (o){
+			case 'n':
+				num_runs = std::strtoull(optarg, NULL, 0);
+				break;
+			case 's':
+				num_steps = std::max<size_t>(std::strtoull(optarg, NULL, 0), 1);
+				break;
+			case 'd':
+				duration = std::strtod(optarg, NULL);
+				break;
+			case 't':
+				num_threads = std::strtoull(optarg, NULL, 0);
+				break;
+			case 'o':
+				out_dir = optarg;
+				break;
+			case 'e':
+				base_seed = std::strtoull(optarg, NULL, 0);
+				seeded = true;
+				break;
+			case 'r':
+				only_run = std::strtoull(optarg, NULL, 0);
+				single_run = true;
+				break;
+			case 'J':
+				use_jit = false;
+				break;
+			case 'h':
+				help_menu();
+				exit(0);
+				break;
+			default:
+				help_menu();
+				exit(1);
+				break;
+		}
+	}
+	if (single_run && !seeded){
+		printf("--run needs the --seed of the campaign it came from\n");
+		return 1;
+	}
+	if (!num_runs && duration <= 0){
+		printf("--runs 0 needs a --duration\n");
+		return 1;
+	}
+	if (!seeded)
+		base_seed = std::chrono::steady_clock::now().time_since_epoch().count();
+	if (optind < argc)
+		LoadCorpus(argv[optind]);
+
+	// A fault means an instruction went outside mem, report which run did it instead of just crashing
+	std::signal(SIGSEGV, FaultHandler);
+	std::signal(SIGBUS, FaultHandler);
+
+	Stats stats;
+	if (single_run){
+		// Save the program first, it may well crash
+		Rng rng = RunRng(only_run);
+		std::string path = SaveProgram(only_run, MakeProgram(rng));
+		printf("Program saved to %s\n", path.c_str());
+		RunChunk(only_run, 1, std::chrono::steady_clock::time_point::max(), &stats);
+		if (!stats.failures)
+			printf("Run %llu passes\n", (unsigned long long) only_run);
+		return stats.failures ? 1 : 0;
+	}
+
+	printf("Fuzzing with seed %llu, %zu programs to mutate, %zu instructions per run%s\n",
+			(unsigned long long) base_seed, corpus.size(), num_steps, (use_jit && Jit().available()) ? ", JIT on" : "");
+	fflush(stdout);
+	auto start = std::chrono::steady_clock::now();
+	auto deadline = (duration > 0) ? start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(duration)) : std::chrono::steady_clock::time_point::max();
+	{
+		ThreadPool pool(num_threads);
+		// With no run limit, keep a few chunks per worker queued until the deadline
+		uint64_t next = 0;
+		while ((num_runs && next < num_runs) || (!num_runs && std::chrono::steady_clock::now() < deadline)){
+			uint64_t count = num_runs ? std::min<uint64_t>(FUZZ_CHUNK, num_runs - next) : FUZZ_CHUNK;
+			pool.Submit([=, &stats]{ RunChunk(next, count, deadline, &stats); });
+			next += count;
+			if (!num_runs && next % (FUZZ_CHUNK * 4 * pool.NumThreads()) == 0)
+				pool.Wait();
+		}
+		pool.Wait();
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	double seconds = elapsed.count();
+	printf("%llu runs, %llu instructions per engine in %.2fs: %.0f runs/s, %.0f instructions/s, %llu failures\n",
+			(unsigned long long) stats.runs, (unsigned long long) stats.instructions, seconds, stats.runs / seconds,
+			stats.instructions / seconds, (unsigned long long) stats.failures);
+	return stats.failures ? 1 : 0;
+}
@@ -0,0 +1,20 @@
+#include <headless.h>
+
+size_t RunHeadless(Scheduler* sched, size_t num_cycles, InputSource* input, OutputSink* output){
+	Chip8* chip8 = sched->cpu->chip8;
+	size_t cycles = 0;
+	while (cycles < num_cycles){
+		input->PollKeys();
+		// Run (up to) one frame worth of instructions
+		cycles += sched->Run(num_cycles - cycles);
+		if (chip8->draw_flag){
+			chip8->draw_flag = false;
+			output->Present();
+		} else if (sched->FrameDone()){
+			output->Idle();
+		}
+		if (sched->FrameDone() && !sched->uncapped)
+			sched->WaitForFrame();
+	}
+	return cycles;
+}
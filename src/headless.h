@@ -0,0 +1,25 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <chip8.h>
+#include <cpu.h>
+#include <io.h>
+#include <scheduler.h>
+
+// Input source for running without SDL, no keys are ever pressed
+class NullInput : public InputSource {
+public:
+	void PollKeys() override {}
+};
+
+// Output sink for running without SDL, frames are dropped
+class NullOutput : public OutputSink {
+public:
+	void Present() override {}
+};
+
+// Runs the scheduler's CPU for num_cycles instructions, as fast as the host allows if the scheduler is uncapped and at
+// 60 frames per second otherwise. Input is polled and output is presented once per frame. Returns the number of cycles executed.
+size_t RunHeadless(Scheduler* sched, size_t num_cycles, InputSource* input, OutputSink* output);
+
+#endif // HEADLESS_H
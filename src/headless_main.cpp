@@ -0,0 +1,261 @@
+// Headless frontend: runs a ROM with no SDL, no window and no sleeping
+#include <chip8.h>
+#include <cpu.h>
+#include <clock.h>
+#include <headless.h>
+#include <jit.h>
+#include <savestate.h>
+#include <replay.h>
+#include <profiler.h>
+#include <trace.h>
+#include <terminal.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+// For parsing CLI args
+#include <getopt.h>
+
+#define DEFAULT_CYCLES 1000000
+
+void help_menu(){
+	printf("Usage: CHIP8-headless [options] <rom>\n"
+			"Options:\n"
+			"-c, --cycles <n>\t\tNumber of instructions to execute (default %d)\n"
+			"-i, --ips <n>\t\t\tEmulated instructions per second, sets how often the 60Hz timers tick (default %d)\n"
+			"-l, --load-state <file>\tResume from a save state instead of starting the ROM from scratch\n"
+			"-S, --save-state <file>\tWrite a save state once the run is over\n"
+			"-r, --replay <file>\t\tReplay a recording made with CHIP8 --record and check the final state matches\n"
+			"    --seed <n>\t\t\tSeed for the random number generator (random by default)\n"
+			"-P, --profile\t\t\tCount executed instructions by kind and address and print a report at the end\n"
+			"-j, --jit\t\t\tTranslate instructions to native code where possible (x86-64 only)\n"
+			"-v, --verbose <type>\t\tTypes: cpu clock (Can only take one parameter), both are traced\n"
+			"-T, --trace <file>\t\tTrace every instruction and clock tick to a binary file, read it with chip8-trace\n"
+			"-a, --load-addr <addr>\t\tLoad the ROM and start running at addr instead of 0x%03X (e.g. 0x%03X for ETI 660 ROMs)\n"
+			"-t, --terminal\t\t\tDraw the screen in the terminal and run at real speed instead of as fast as possible\n"
+			"-w, --wrap-sprites\t\tSprites wrap around the screen edges instead of being clipped\n"
+			"-h, --help\t\t\tThis help menu\n", DEFAULT_CYCLES, DEFAULT_IPS, ROM_START, ETI_ROM_START);
+}
+
+int main(int argc, char *argv[]){
+	size_t num_cycles = DEFAULT_CYCLES;
+	size_t ips = DEFAULT_IPS;
+	bool use_jit = false;
+	bool wrap_sprites = false;
+	uint16_t load_addr = ROM_START;
+	const char* load_state = NULL;
+	const char* save_state = NULL;
+	const char* replay_path = NULL;
+	bool seeded = false;
+	uint32_t seed = 0;
+	bool profile = false;
+	const char* trace_path = NULL;
+	bool terminal = false;
+	int o;
+	int opt_index = 0;
+
+	const struct option long_opts[] =
+	{
+		{"cycles", required_argument, 0, 'c'},
+		{"ips", required_argument, 0, 'i'},
+		{"jit", no_argument, 0, 'j'},
+		{"load-state", required_argument, 0, 'l'},
+		{"save-state", required_argument, 0, 'S'},
+		{"replay", required_argument, 0, 'r'},
+		{"profile", no_argument, 0, 'P'},
+		{"trace", required_argument, 0, 'T'},
+		{"seed", required_argument, 0, 'e'},
+		{"verbose",   optional_argument,  0, 'v'},
+		{"load-addr", required_argument, 0, 'a'},
+		{"terminal",   no_argument,  0, 't'},
+		{"wrap-sprites",   no_argument,  0, 'w'},
+		{"help",   no_argument,  0, 'h'},
+		{0,0,0,0},
+	};
+
+	while ((o = getopt_long(argc, argv, "hjPta:c:i:l:r:S:T:v::w", long_opts, &opt_index)) != -1){
+		switch (o){
+			case 'c':
+				num_cycles = std::strtoull(optarg, NULL, 0);
+				break;
+			case 'i':
+				ips = std::strtoull(optarg, NULL, 0);
+				// Frames of 0 instructions would never get anywhere
+				if (!ips){
+					printf("Invalid instructions per second \"%s\"\n", optarg);
+					help_menu();
+					exit(1);
+				}
+				break;
+			case 'j':
+				use_jit = true;
+				break;
+			case 'l':
+				load_state = optarg;
+				break;
+			case 'S':
+				save_state = optarg;
+				break;
+			case 'r':
+				replay_path = optarg;
+				break;
+			case 'P':
+				profile = true;
+				break;
+			case 'T':
+				trace_path = optarg;
+				break;
+			case 'e':
+				seed = std::strtoul(optarg, NULL, 0);
+				seeded = true;
+				break;
+			case 'v':
+				// Multiple args for one flag is not possible
+				if (optarg == NULL && optind < argc
+						&& argv[optind][0] != '-')
+					optarg = argv[optind++];
+
+				if (optarg == NULL || strcmp(optarg, "cpu") == 0)
+					VERBOSE_CPU = true;
+				if (optarg == NULL || strcmp(optarg, "clock") == 0)
+					VERBOSE_CLOCK = true;
+				break;
+			case 'a':
+				// Anything past 0xFFFF is just as invalid, and LoadROM says so
+				load_addr = std::min(std::strtoul(optarg, NULL, 0), 0xFFFFUL);
+				break;
+			case 't':
+				terminal = true;
+				break;
+			case 'w':
+				wrap_sprites = true;
+				break;
+			case 'h':
+				help_menu();
+				exit(0);
+				break;
+			default:
+				help_menu();
+				exit(1);
+				break;
+		}
+	}
+
+	if (optind >= argc){
+		help_menu();
+		exit(1);
+	}
+	const char* rom_path = argv[optind];
+
+	// A replay brings its own settings
+	Replay replay;
+	if (replay_path){
+		if (!replay.Load(replay_path))
+			return 1;
+		if (load_state){
+			printf("Recordings start from the beginning of the ROM, --load-state can't be used with --replay\n");
+			return 1;
+		}
+		if (HashFile(rom_path) != replay.header.rom_hash)
+			printf("Warning: \"%s\" is not the ROM this was recorded with\n", rom_path);
+		ips = replay.header.ips;
+		seed = replay.header.seed;
+		seeded = true;
+		wrap_sprites = replay.header.wrap_sprites;
+		load_addr = replay.header.load_addr;
+	}
+
+	Chip8 chip8;
+	chip8.wrap_sprites = wrap_sprites;
+	RomError err = chip8.LoadROM(rom_path, load_addr);
+	if (err != ROM_OK){
+		printf("Failed to load \"%s\": %s\n", rom_path, RomErrorString(err));
+		return 1;
+	}
+	Clock clock;
+	CPU cpu(&chip8, &clock);
+	cpu.pc = load_addr;
+	NullInput input;
+	NullOutput null_output;
+	std::unique_ptr<TerminalOutput> terminal_output;
+	OutputSink* output = &null_output;
+	if (terminal){
+		terminal_output.reset(new TerminalOutput(&chip8));
+		output = terminal_output.get();
+	}
+	if (seeded)
+		cpu.seed(seed);
+	Jit jit;
+	if (use_jit && jit.available())
+		cpu.jit = &jit;
+	Profiler profiler;
+	if (profile)
+		cpu.profiler = &profiler;
+	// --trace records everything, -v cpu and -v clock only their part
+	Tracer tracer(&cpu);
+	if (trace_path || VERBOSE_CPU || VERBOSE_CLOCK){
+		if (!trace_path)
+			trace_path = DEFAULT_TRACE_PATH;
+		if (!tracer.Start(trace_path))
+			return 1;
+		if (VERBOSE_CPU || !VERBOSE_CLOCK)
+			cpu.tracer = &tracer;
+		if (VERBOSE_CLOCK || !VERBOSE_CPU)
+			clock.tracer = &tracer;
+	}
+
+	Scheduler sched(&cpu, &clock, ips);
+	if (load_state){
+		SaveState state;
+		if (!ReadState(load_state, &state))
+			return 1;
+		RestoreState(&sched, &state);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	// A loaded state carries on counting from where it was saved
+	uint64_t start_cycles = cpu.cycles;
+	// Watching it in the terminal is only any use at the speed it was meant to run at
+	sched.uncapped = !terminal;
+	bool replay_ok = true;
+	if (replay_path)
+		replay_ok = replay.Run(&sched);
+	else
+		RunHeadless(&sched, num_cycles, &input, output);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	uint64_t terminal_bytes = 0;
+	if (terminal_output){
+		// Puts the cursor back below the screen before anything else gets printed
+		terminal_bytes = terminal_output->bytes_written;
+		terminal_output.reset();
+	}
+
+	size_t run_cycles = cpu.cycles - start_cycles;
+	printf("Executed %zu cycles in %.3fs (%.0f instructions/sec)\n",
+			run_cycles, elapsed.count(), run_cycles / elapsed.count());
+	cpu.print_registers();
+	if (!sched.uncapped)
+		clock.print_stats();
+	if (terminal)
+		printf("Sent %llu bytes to the terminal\n", (unsigned long long) terminal_bytes);
+	if (trace_path){
+		tracer.Stop();
+		printf("Traced %llu records to \"%s\"\n", (unsigned long long) tracer.records, trace_path);
+	}
+	if (profile)
+		profiler.Report(&cpu);
+	if (replay_path){
+		if (replay_ok)
+			printf("Replay matches the recorded final state\n");
+		else
+			printf("Replay diverged: the final state does not match the recording\n");
+	}
+	if (save_state){
+		SaveState state;
+		CaptureState(&sched, &state);
+		if (!WriteState(save_state, &state))
+			return 1;
+	}
+	return replay_ok ? 0 : 1;
+}
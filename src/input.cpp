@@ -1,13 +1,92 @@
 #include <input.h>
 #include <display.h>
-// key_map<scancode, register>
-std::map<uint8_t, uint8_t> key_map = {
-	{0x1E, 0x1}, {0x1F, 0x2}, {0x20, 0x3}, {0x21, 0xC},
-	{0x14, 0x4}, {0x1A, 0x5}, {0x08, 0x6}, {0x15, 0xD},
-	{0x04, 0x7}, {0x16, 0x8}, {0x07, 0x9}, {0x09, 0xE},
-	{0x1D, 0xA}, {0x1B, 0x0}, {0x06, 0xB}, {0x19, 0xF},
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+// Keypad layout on the left of a QWERTY keyboard:
+// 1 2 3 4      1 2 3 C
+// Q W E R  ->  4 5 6 D
+// A S D F      7 8 9 E
+// Z X C V      A 0 B F
+const struct {
+	SDL_Scancode scancode;
+	uint8_t key;
+} default_bindings[NUM_KEYS] = {
+	{SDL_SCANCODE_1, 0x1}, {SDL_SCANCODE_2, 0x2}, {SDL_SCANCODE_3, 0x3}, {SDL_SCANCODE_4, 0xC},
+	{SDL_SCANCODE_Q, 0x4}, {SDL_SCANCODE_W, 0x5}, {SDL_SCANCODE_E, 0x6}, {SDL_SCANCODE_R, 0xD},
+	{SDL_SCANCODE_A, 0x7}, {SDL_SCANCODE_S, 0x8}, {SDL_SCANCODE_D, 0x9}, {SDL_SCANCODE_F, 0xE},
+	{SDL_SCANCODE_Z, 0xA}, {SDL_SCANCODE_X, 0x0}, {SDL_SCANCODE_C, 0xB}, {SDL_SCANCODE_V, 0xF},
 };
 
+uint8_t key_map[KEY_MAP_SIZE];
+InputLatency input_latency;
+
+namespace {
+	int64_t now_ns(){
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Fills key_map before main runs
+	struct DefaultKeyMap {
+		DefaultKeyMap(){
+			memset(key_map, NO_KEY, sizeof(key_map));
+			for (const auto& binding : default_bindings)
+				key_map[binding.scancode] = binding.key;
+		}
+	} default_key_map;
+}
+
+// Key state as of the last PumpEvents. Written on the SDL thread, read from the emulation thread.
+namespace {
+	std::atomic<bool> held[SDL_NUM_SCANCODES];
+	std::atomic<uint16_t> chip8_keys(0); // Bitmask of the chip8 keys held down
+	std::atomic<uint16_t> tapped(0); // Keys that went down since the last PollKeys, even if they're already back up
+	std::atomic<int64_t> changed_at(0); // When the oldest change PollKeys hasn't picked up yet was handled, 0 if none
+
+	// Keyboard keys held down for each chip8 key, only touched on the SDL thread
+	uint8_t key_holders[NUM_KEYS] = {0};
+
+	void handle_key(SDL_Scancode scancode, bool down){
+		// Key repeat sends more presses of a key that's already down, those aren't changes
+		if (held[scancode].exchange(down) == down)
+			return;
+		uint8_t key = InputHandler::GetKeyRegister(scancode);
+		if (key == NO_KEY)
+			return;
+		// With several keyboard keys bound to it, a chip8 key goes down with the first and up with the last
+		key_holders[key] += down ? 1 : -1;
+		if (key_holders[key] != (down ? 1 : 0))
+			return;
+		uint16_t bit = 1 << key;
+		if (down){
+			chip8_keys |= bit;
+			tapped |= bit;
+		} else {
+			chip8_keys &= ~bit;
+		}
+		int64_t none = 0;
+		changed_at.compare_exchange_strong(none, now_ns());
+	}
+
+	// Returns false if the event asks to quit
+	bool handle_event(const SDL_Event& event){
+		switch (event.type){
+			case SDL_QUIT:
+				return false;
+			case SDL_KEYDOWN:
+			case SDL_KEYUP:
+				handle_key(event.key.keysym.scancode, event.type == SDL_KEYDOWN);
+				if (VERBOSE_INPUT) InputHandler::PrintKeyInfo((SDL_KeyboardEvent*) &event.key);
+				return !(event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_ESCAPE);
+		}
+		return true;
+	}
+}
+
 // For debugging
 void InputHandler::PrintChip8Keys(Chip8* chip8){
 	bool* keys = chip8->keys;
@@ -47,35 +126,25 @@ void InputHandler::PrintKeyInfo(SDL_KeyboardEvent *key){
 }
 
 
-// Gets and sets the flags in the chip8 keys array which determine if they are being pressed or not.
-void InputHandler::GetChip8Keys(Chip8* chip8){
-	/* "One important thing to know about how SDL handles key states is that you still need an event loop running. 
-	 * SDL's internal keystates are updated every time SDL_PollEvent is called, so make sure you polled all 
-	 * events on queue before checking key states." https://lazyfoo.net/tutorials/SDL/18_key_states/index.php */
+bool InputHandler::PumpEvents(uint32_t wait_ms){
 	SDL_Event event;
-	SDL_PollEvent(&event);
-	const uint8_t *kb_state = SDL_GetKeyboardState(NULL);
-	if (kb_state[SDL_SCANCODE_ESCAPE]){
-		ExitChip8();
-	}
-	for (std::map<uint8_t, uint8_t>::iterator itr = key_map.begin(); itr != key_map.end(); itr++){
-		uint8_t key_code = itr->first;
-		uint8_t key_reg = itr->second;
-		if (kb_state[key_code])
-			chip8->keys[key_reg] = true;		
-		else
-			chip8->keys[key_reg] = false;
-	}
+	bool running = true;
+	if (wait_ms && SDL_WaitEventTimeout(&event, wait_ms))
+		running = handle_event(event);
+	while (SDL_PollEvent(&event))
+		running = handle_event(event) && running;
+	return running;
 }
 
 // Waits for a valid Chip8 key to be pressed and returns its scancode
 uint8_t InputHandler::WaitForKeyPress(){
 	SDL_Event event;
 	SDL_KeyboardEvent *key;
-	uint8_t scancode;
+	SDL_Scancode scancode;
 	uint32_t event_type;
 	// Wait until a key event before continuing code execution
 	while(SDL_WaitEvent(&event)){
+		handle_event(event);
 		key = &event.key;
 		event_type = key->type;
 		scancode = key->keysym.scancode;
@@ -84,7 +153,7 @@ uint8_t InputHandler::WaitForKeyPress(){
 			if (!DEBUG_MODE) ExitChip8();
 
 		// Only break if we find a valid key mapped to the chip8
-		if (event_type == SDL_KEYUP && (key_map.find(scancode) != key_map.end())) 
+		if (event_type == SDL_KEYUP && GetKeyRegister(scancode) != NO_KEY)
 			break;
 	}
 	return scancode;
@@ -92,13 +161,84 @@ uint8_t InputHandler::WaitForKeyPress(){
 
 // Convert SDL scancode into v register index x
 // If this returns 0x10, then an invalid or no key was pressed
-uint8_t InputHandler::GetKeyRegister(uint8_t scancode){
-	uint8_t v_reg = 0x10;
+uint8_t InputHandler::GetKeyRegister(SDL_Scancode scancode){
+	return (scancode < KEY_MAP_SIZE) ? key_map[scancode] : NO_KEY;
+}
+
+/* One binding per line, the chip8 key in hex and then the SDL name of the key bound to it, e.g.
+ *   C 4
+ *   A Left Shift
+ * A key can be bound to several keyboard keys. Listing a chip8 key drops its default binding, keys that aren't listed
+ * keep theirs. Empty lines and lines starting with # are skipped. */
+bool InputHandler::LoadKeyMap(const char* path){
+	std::ifstream file(path);
+	if (!file){
+		printf("Couldn't open key bindings \"%s\"\n", path);
+		return false;
+	}
+	uint8_t new_map[KEY_MAP_SIZE];
+	memcpy(new_map, key_map, sizeof(new_map));
+	bool rebound[NUM_KEYS] = {0};
+	std::string line;
+	for (int line_num = 1; std::getline(file, line); line_num++){
+		std::istringstream fields(line);
+		std::string key_str, name;
+		if (!(fields >> key_str) || key_str[0] == '#')
+			continue;
+		std::getline(fields >> std::ws, name);
+		while (!name.empty() && isspace((unsigned char) name.back()))
+			name.pop_back();
+		char* end;
+		unsigned long key = std::strtoul(key_str.c_str(), &end, 16);
+		SDL_Scancode scancode = SDL_GetScancodeFromName(name.c_str());
+		if (*end || key >= NUM_KEYS || scancode == SDL_SCANCODE_UNKNOWN || scancode >= KEY_MAP_SIZE){
+			printf("%s:%d: expected a chip8 key (0-F) and a key name, got \"%s\"\n", path, line_num, line.c_str());
+			return false;
+		}
+		if (!rebound[key]){
+			for (uint8_t& bound : new_map)
+				if (bound == key)
+					bound = NO_KEY;
+			rebound[key] = true;
+		}
+		new_map[scancode] = key;
+	}
+	memcpy(key_map, new_map, sizeof(key_map));
+	return true;
+}
 
-	if (key_map.find(scancode) != key_map.end()){
-		v_reg = key_map[scancode];
-		printf("v_reg: 0x%01x\n", v_reg);
+void InputHandler::PrintLatency(){
+	if (!input_latency.count){
+		printf("Input latency: no key changes\n");
+		return;
 	}
-	return v_reg;
+	printf("Input latency: %lu key changes, average %.3fms, worst %.3fms\n", (unsigned long) input_latency.count,
+			input_latency.total_ns / 1e6 / input_latency.count, input_latency.max_ns / 1e6);
 }
 
+bool InputHandler::HotkeyPressed(SDL_Scancode scancode){
+	static bool was_down[SDL_NUM_SCANCODES] = {0};
+	bool down = held[scancode];
+	bool pressed = down && !was_down[scancode];
+	was_down[scancode] = down;
+	return pressed;
+}
+
+bool InputHandler::HotkeyHeld(SDL_Scancode scancode){
+	return held[scancode];
+}
+
+void SDLInput::PollKeys(){
+	// Taking the timestamp first means a change handled right after it is counted next time instead of being lost
+	int64_t since = changed_at.exchange(0);
+	// A key tapped between two polls still shows up as held for one frame, or Fx0A would never see it released
+	uint16_t mask = tapped.exchange(0) | chip8_keys;
+	if (since){
+		uint64_t latency = std::max<int64_t>(now_ns() - since, 0);
+		input_latency.count++;
+		input_latency.total_ns += latency;
+		input_latency.max_ns = std::max(input_latency.max_ns, latency);
+	}
+	for (int key = 0; key < NUM_KEYS; key++)
+		chip8->keys[key] = (mask >> key) & 1;
+}
@@ -4,23 +4,61 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL_timer.h>
-#include <map>
+#include <cstdint>
 
 #include <chip8.h>
+#include <io.h>
 
 namespace InputHandler {
 	// For debugging
 	void PrintChip8Keys(Chip8* chip8); 
 	void PrintKeyInfo(SDL_KeyboardEvent *key); 
-	// Gets and sets the flags in the chip8 keys array which determine if they are being pressed or not.
-	void GetChip8Keys(Chip8* chip8);
+	// Handles every event in SDL's queue, waiting up to wait_ms for the first one, and updates the key state the rest
+	// of the input code reads. Returns false once the user asked to quit (Escape or closing the window).
+	// SDL only delivers events to the thread that created the window, so this has to be called from that one.
+	bool PumpEvents(uint32_t wait_ms = 0);
 	// Stops all code execution and waits for a valid chip8 key to be pressed, resumes execution, and 
 	// then returns the scancode value of the key pressed.
 	uint8_t WaitForKeyPress();
-	// Takes a key's scancode as the parameter and returns the v register index from our global key_map
-	uint8_t GetKeyRegister(uint8_t scancode);
+	// Takes a key's scancode as the parameter and returns the chip8 key it's bound to, NO_KEY if none
+	uint8_t GetKeyRegister(SDL_Scancode scancode);
+	// Rebind keys from a file, see LoadKeyMap in input.cpp for the format. Returns false (and keeps the old bindings)
+	// if the file can't be read or has a bad line.
+	bool LoadKeyMap(const char* path);
+	// Time from key events being handled to the CPU seeing them, as measured by SDLInput::PollKeys
+	void PrintLatency();
+	// True once each time a (non chip8) key goes down, for emulator hotkeys. Uses the state from the last PumpEvents,
+	// so it can be called from any thread (but only ever from the same one).
+	bool HotkeyPressed(SDL_Scancode scancode);
+	// True for as long as a (non chip8) key is held down, from any thread
+	bool HotkeyHeld(SDL_Scancode scancode);
 }
 
-extern std::map<uint8_t, uint8_t> key_map;
+// Scancodes below KEY_MAP_SIZE that can be bound to chip8 keys, which covers every key on a normal keyboard
+#define KEY_MAP_SIZE 0x100
+// Chip8 key bound to each scancode, NO_KEY for unbound ones
+extern uint8_t key_map[KEY_MAP_SIZE];
+
+// How long key changes waited between PumpEvents seeing them and PollKeys handing them to the CPU
+struct InputLatency {
+	uint64_t count = 0;
+	uint64_t total_ns = 0;
+	uint64_t max_ns = 0;
+};
+extern InputLatency input_latency;
+
+// InputSource backed by the SDL keyboard. PollKeys doesn't touch SDL, it reads what InputHandler::PumpEvents saw on the
+// SDL thread, so the CPU can run on another thread.
+class SDLInput : public InputSource {
+public:
+	Chip8* chip8;
+
+	SDLInput(Chip8* chip8) : chip8(chip8) {}
+
+	// Copies the chip8 keys held as of the last PumpEvents into chip8->keys, and measures how long changes took to get
+	// here. The main loop polls once a frame, so a change is seen within a frame (plus however long PumpEvents took to
+	// notice it).
+	void PollKeys() override;
+};
 
 #endif // INPUT_H
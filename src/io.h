@@ -0,0 +1,29 @@
+#ifndef IO_H
+#define IO_H
+
+#include <stdint.h>
+
+// Pluggable input/output for the emulation core. The core (Chip8, CPU, Clock) never touches SDL,
+// frontends (SDL, headless, ...) implement these and hand them to the CPU/main loop.
+
+// Stands for no chip8 key, e.g. for a keyboard key that isn't bound to one
+#define NO_KEY 0x10
+
+class InputSource {
+public:
+	virtual ~InputSource() {}
+	// Update the chip8 keys array. Called once per frame by the main loop, not once per instruction.
+	// This is the only way keys reach the CPU, Fx0A waits on the keys array as well.
+	virtual void PollKeys() = 0;
+};
+
+class OutputSink {
+public:
+	virtual ~OutputSink() {}
+	// Present the current contents of the chip8 framebuffer
+	virtual void Present() = 0;
+	// Called at the end of every frame that drew nothing, for sinks that held back an earlier frame
+	virtual void Idle() {}
+};
+
+#endif // IO_H
@@ -0,0 +1,187 @@
+#include <jit.h>
+#include <cpu.h>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+// Longest native sequence emit() produces for one instruction, including the count check after it
+#define JIT_MAX_INSN_BYTES 32
+#define JIT_BLOCK_BYTES (JIT_MAX_BLOCK * JIT_MAX_INSN_BYTES + 1)
+
+Jit::Jit(){
+#ifdef JIT_SUPPORTED
+	void* buf = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf != MAP_FAILED)
+		code = (uint8_t*) buf;
+	else
+		printf("JIT: could not map executable memory, using the interpreter\n");
+#endif
+}
+
+Jit::~Jit(){
+#ifdef JIT_SUPPORTED
+	if (code)
+		munmap(code, JIT_CODE_SIZE);
+#endif
+}
+
+size_t Jit::run(CPU* cpu, size_t max_cycles){
+	uint16_t addr = cpu->pc & (MEM_SIZE - 1);
+	Block& block = blocks[addr];
+	if (!block.compiled)
+		compile(cpu->mem, addr);
+	if (!block.len)
+		return 0;
+	size_t n = std::min((size_t)block.len, max_cycles);
+	block.fn(cpu->v, &cpu->i, n);
+	cpu->pc = (cpu->pc + n * 2) & (MEM_SIZE - 1);
+	return n;
+}
+
+void Jit::invalidate(uint16_t addr, uint16_t len){
+	// Any block starting up to JIT_MAX_BLOCK instructions before addr can cover it
+	for (uint32_t a = addr + MEM_SIZE - JIT_MAX_BLOCK * 2; a < (uint32_t)addr + MEM_SIZE + len; a++)
+		blocks[a & (MEM_SIZE - 1)].compiled = false;
+}
+
+void Jit::flush(){
+	for (int a = 0; a < MEM_SIZE; a++)
+		blocks[a].compiled = false;
+	code_used = 0;
+}
+
+void Jit::compile(const uint8_t* mem, uint16_t addr){
+	Block& block = blocks[addr];
+	block.compiled = true;
+	block.len = 0;
+	if (!code)
+		return;
+	// Start over once the buffer can't hold a full block. This only happens between blocks, never while one runs.
+	if (code_used + JIT_BLOCK_BYTES > JIT_CODE_SIZE){
+		flush();
+		block.compiled = true;
+	}
+
+	size_t start = code_used;
+	// Stop before the last byte of memory, the interpreter deals with fetches that run off the end
+	for (uint32_t a = addr; block.len < JIT_MAX_BLOCK && a < MEM_SIZE - 1; a += 2){
+		uint16_t opcode = mem[a] << 8 | mem[a + 1];
+		if (!emit(opcode))
+			break;
+		// Return once count instructions have run, so a block can be cut short at the end of a frame
+		emit_bytes({0xFF, 0xCA}); // dec edx
+		emit_bytes({0x75, 0x01}); // jnz over the ret
+		emit_bytes({0xC3}); // ret
+		block.len++;
+	}
+	if (!block.len){
+		code_used = start;
+		return;
+	}
+	emit_bytes({0xC3}); // ret
+	block.fn = (JitBlock) (code + start);
+}
+
+void Jit::emit_bytes(std::initializer_list<uint8_t> bytes){
+	for (uint8_t b : bytes)
+		code[code_used++] = b;
+}
+
+/* The block is called as fn(v, &i, count), so rdi points to the V registers, rsi to I and edx holds the number of
+ * instructions left to run. Only al/eax is used as scratch.
+ * Every sequence mirrors its handler in cpu.cpp exactly, including the order VF is written in when x or y is F. */
+bool Jit::emit(uint16_t opcode){
+	uint8_t x = Op::x(opcode);
+	uint8_t y = Op::y(opcode);
+	uint8_t kk = Op::kk(opcode);
+	uint16_t nnn = Op::nnn(opcode);
+	switch(opcode & 0xF000){
+		case 0x0000:
+			// 0nnn - SYS addr is ignored, 00E0, 00EE and the SUPER-CHIP 00Cn/00FB-00FF are left to the interpreter
+			if (kk == 0xE0 || kk == 0xEE || kk >= 0xFB || (kk & 0xF0) == 0xC0)
+				return false;
+			return true;
+		case 0x6000: // 6xkk - LD Vx, byte
+			emit_bytes({0xC6, 0x47, x, kk}); // mov byte [rdi+x], kk
+			return true;
+		case 0x7000: // 7xkk - ADD Vx, byte
+			emit_bytes({0x80, 0x47, x, kk}); // add byte [rdi+x], kk
+			return true;
+		case 0x8000:
+			switch(opcode & 0x000F){
+				case 0x0000: // 8xy0 - LD Vx, Vy
+					emit_bytes({0x8A, 0x47, y}); // mov al, [rdi+y]
+					emit_bytes({0x88, 0x47, x}); // mov [rdi+x], al
+					return true;
+				case 0x0001: // 8xy1 - OR Vx, Vy
+					emit_bytes({0x8A, 0x47, y}); // mov al, [rdi+y]
+					emit_bytes({0x08, 0x47, x}); // or [rdi+x], al
+					return true;
+				case 0x0002: // 8xy2 - AND Vx, Vy
+					emit_bytes({0x8A, 0x47, y}); // mov al, [rdi+y]
+					emit_bytes({0x20, 0x47, x}); // and [rdi+x], al
+					return true;
+				case 0x0003: // 8xy3 - XOR Vx, Vy
+					emit_bytes({0x8A, 0x47, y}); // mov al, [rdi+y]
+					emit_bytes({0x30, 0x47, x}); // xor [rdi+x], al
+					return true;
+				case 0x0004: // 8xy4 - ADD Vx, Vy, VF = Vy > Vx afterwards
+					emit_bytes({0x8A, 0x47, y}); // mov al, [rdi+y]
+					emit_bytes({0x00, 0x47, x}); // add [rdi+x], al
+					emit_bytes({0x8A, 0x47, y}); // mov al, [rdi+y]
+					emit_bytes({0x3A, 0x47, x}); // cmp al, [rdi+x]
+					emit_bytes({0x0F, 0x97, 0xC0}); // seta al
+					emit_bytes({0x88, 0x47, 0x0F}); // mov [rdi+0xF], al
+					return true;
+				case 0x0005: // 8xy5 - SUB Vx, Vy, VF = Vx > Vy beforehand
+					emit_bytes({0x8A, 0x47, x}); // mov al, [rdi+x]
+					emit_bytes({0x3A, 0x47, y}); // cmp al, [rdi+y]
+					emit_bytes({0x0F, 0x97, 0xC0}); // seta al
+					emit_bytes({0x88, 0x47, 0x0F}); // mov [rdi+0xF], al
+					emit_bytes({0x8A, 0x47, y}); // mov al, [rdi+y]
+					emit_bytes({0x28, 0x47, x}); // sub [rdi+x], al
+					return true;
+				case 0x0006: // 8xy6 - SHR Vx {, Vy}
+					emit_bytes({0x8A, 0x47, x}); // mov al, [rdi+x]
+					emit_bytes({0x24, 0x01}); // and al, 1
+					emit_bytes({0x88, 0x47, 0x0F}); // mov [rdi+0xF], al
+					emit_bytes({0xD0, 0x6F, x}); // shr byte [rdi+x], 1
+					return true;
+				case 0x0007: // 8xy7 - SUBN Vx, Vy, VF = Vy > Vx beforehand
+					emit_bytes({0x8A, 0x47, y}); // mov al, [rdi+y]
+					emit_bytes({0x3A, 0x47, x}); // cmp al, [rdi+x]
+					emit_bytes({0x0F, 0x97, 0xC0}); // seta al
+					emit_bytes({0x88, 0x47, 0x0F}); // mov [rdi+0xF], al
+					emit_bytes({0x8A, 0x47, y}); // mov al, [rdi+y]
+					emit_bytes({0x2A, 0x47, x}); // sub al, [rdi+x]
+					emit_bytes({0x88, 0x47, x}); // mov [rdi+x], al
+					return true;
+				case 0x000E: // 8xyE - SHL Vx {, Vy}
+					emit_bytes({0x8A, 0x47, x}); // mov al, [rdi+x]
+					emit_bytes({0xC0, 0xE8, MSB_POS}); // shr al, 7
+					emit_bytes({0x88, 0x47, 0x0F}); // mov [rdi+0xF], al
+					emit_bytes({0xD0, 0x67, x}); // shl byte [rdi+x], 1
+					return true;
+			}
+			return false;
+		case 0xA000: // Annn - LD I, addr
+			emit_bytes({0x66, 0xC7, 0x06, (uint8_t)(nnn & 0xFF), (uint8_t)(nnn >> 8)}); // mov word [rsi], nnn
+			return true;
+		case 0xF000:
+			switch(kk){
+				case 0x1E: // Fx1E - ADD I, Vx
+					emit_bytes({0x0F, 0xB6, 0x47, x}); // movzx eax, byte [rdi+x]
+					emit_bytes({0x66, 0x01, 0x06}); // add [rsi], ax
+					return true;
+				case 0x29: // Fx29 - LD F, Vx
+					emit_bytes({0x0F, 0xB6, 0x47, x}); // movzx eax, byte [rdi+x]
+					emit_bytes({0x8D, 0x04, 0x80}); // lea eax, [rax+rax*4]
+					emit_bytes({0x66, 0x89, 0x06}); // mov [rsi], ax
+					return true;
+			}
+			return false;
+	}
+	return false;
+}
@@ -0,0 +1,55 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <chip8.h>
+#include <initializer_list>
+
+class CPU;
+
+// Most instructions compiled into a single block
+#define JIT_MAX_BLOCK 32
+// Size of the executable buffer holding compiled blocks. Everything is recompiled once it fills up.
+#define JIT_CODE_SIZE (1 << 20)
+
+// A compiled block only touches the V registers and I. It returns after count instructions or at its end.
+typedef void (*JitBlock)(uint8_t* v, uint16_t* i, uint32_t count);
+
+/* Dynamic recompiler for x86-64 hosts
+ * Straight-line runs of register-only instructions (6xkk, 7xkk, 8xyN, Annn, Fx1E, Fx29 and 0nnn) are translated
+ * into native code and cached by start address. Anything else (branches, skips, DRW, Fx0A, timers, memory writes,
+ * invalid opcodes) ends the block and is left to the interpreter. Blocks are dropped when the memory they were
+ * compiled from is written to (see CPU::invalidate). */
+class Jit {
+public:
+	Jit();
+	~Jit();
+
+	// False if the host isn't x86-64 or no executable memory could be mapped
+	bool available() const { return code != nullptr; }
+
+	// Runs the block starting at cpu->pc for at most max_cycles instructions.
+	// Returns the number of instructions executed, 0 means the interpreter has to run the instruction at pc.
+	size_t run(CPU* cpu, size_t max_cycles);
+
+	// Drop blocks compiled from mem[addr] to mem[addr+len-1]
+	void invalidate(uint16_t addr, uint16_t len);
+	// Drop every block
+	void flush();
+
+private:
+	struct Block {
+		JitBlock fn = nullptr;
+		uint8_t len = 0; // Number of instructions in the block
+		bool compiled = false; // A compiled block can be empty (len 0) when its first instruction isn't supported
+	};
+	Block blocks[MEM_SIZE];
+	uint8_t* code = nullptr;
+	size_t code_used = 0;
+
+	void compile(const uint8_t* mem, uint16_t addr);
+	// Appends the native code for one instruction, false if the instruction isn't supported
+	bool emit(uint16_t opcode);
+	void emit_bytes(std::initializer_list<uint8_t> bytes);
+};
+
+#endif // JIT_H
@@ -2,35 +2,106 @@
 #include <cpu.h>
 #include <display.h>
 #include <input.h>
+#include <audio.h>
 #include <clock.h>
 #include <dir_nav.h>
+#include <jit.h>
+#include <scheduler.h>
+#include <savestate.h>
+#include <rewind.h>
+#include <replay.h>
+#include <profiler.h>
+#include <trace.h>
+#include <frame.h>
+#include <seek.h>
 #include <iostream>
 #include <filesystem>
+#include <atomic>
+#include <thread>
+#include <chrono>
 
 
 // For parsing CLI args
 #include <getopt.h>
 
-bool SLOW_MODE = false;
-bool DEBUG_MODE  = false;
-bool VERBOSE_CLOCK = false;
-bool VERBOSE_CPU = false;
-bool VERBOSE_DISPLAY = false;
-bool VERBOSE_INPUT = false;
-
 void help_menu(){
 	printf("Options:\n"
-			"-d, --debug-mode <start_frame>\tEnable step-by-step execution and skip to the specified frame\n"
-			"-v, --verbose <type>\t\tTypes: cpu clock display input (Can only take one parameter)\n"
-			"-s, --slow-mode\t\t\tRuns the emulator at a slower speed\n"
-			"-h, --help\t\t\tThis help menu\n");
+			"-p, --path <dir>\t\tDirectory of ROMs to pick from (default %s)\n"
+			"-d, --debug-mode <target>\tEnable step-by-step execution, starting once target is reached:\n"
+			"\t\t\t\t<n> instructions, frame=<n>, or a condition like pc=0x2A4 or v3>=10\n"
+			"-v, --verbose <type>\t\tTypes: cpu clock display input (Can only take one parameter). cpu and clock are traced,\n"
+			"\t\t\t\tdisplay draws the screen in the terminal too\n"
+			"-T, --trace <file>\t\tTrace every instruction and clock tick to a binary file, read it with chip8-trace\n"
+			"-s, --slow-mode\t\t\tRuns the emulator at a slower speed (%d instructions per second)\n"
+			"-i, --ips <n>\t\t\tInstructions per second (default %d)\n"
+			"-u, --uncapped\t\t\tRun as fast as possible instead of at 60 frames per second (same as --speed 0)\n"
+			"-f, --speed <n>\t\t\tRun at n times normal speed, 0 is as fast as possible\n"
+			"-t, --turbo <n>\t\t\tSpeed while tab is held (default %d, as fast as possible)\n"
+			"-j, --jit\t\t\tTranslate instructions to native code where possible (x86-64 only)\n"
+			"-l, --load-state <file>\tStart from a save state\n"
+			"    --slot <n>\t\t\tSave state slot used by F5 (save) and F9 (load), default 0\n"
+			"-R, --record <file>\t\tRecord keys to a file on exit, replay it with CHIP8-headless --replay\n"
+			"    --seed <n>\t\t\tSeed for the random number generator (random by default)\n"
+			"-P, --profile\t\t\tCount executed instructions by kind and address, report on exit or with F2\n"
+			"-r, --rewind-mb <n>\t\tMemory for rewind history in MB, 0 disables it (default %d). Hold backspace to rewind\n"
+			"-a, --load-addr <addr>\t\tLoad the ROM and start running at addr instead of 0x%03X (e.g. 0x%03X for ETI 660 ROMs)\n"
+			"-k, --keys <file>\t\tLoad key bindings from a file (lines of \"<chip8 key> <key name>\", e.g. \"C 4\")\n"
+			"-b, --audio-buffer <n>\t\tSamples per audio callback (default %d), smaller beeps with less delay. 0 turns sound off\n"
+			"-w, --wrap-sprites\t\tSprites wrap around the screen edges instead of being clipped\n"
+			"-h, --help\t\t\tThis help menu\n", DEFAULT_GAMES_DIR, SLOW_MODE_IPS, DEFAULT_IPS, DEFAULT_TURBO_SPEED, REWIND_DEFAULT_BUDGET >> 20,
+			ROM_START, ETI_ROM_START, DEFAULT_AUDIO_BUFFER);
 }
 
 SDL_Window* window;
 
+// Set while recording, the recording is written when the emulator exits (which can happen from deep inside the input code)
+InputRecorder* recorder = NULL;
+ReplayHeader record_header;
+const char* record_path = NULL;
+
+void save_recording(){
+	if (recorder && recorder->Write(record_path, record_header))
+		printf("Saved recording to \"%s\"\n", record_path);
+	recorder = NULL;
+}
+
+// Set with --profile, reported when the emulator exits
+Profiler* profiler = NULL;
+CPU* profiled_cpu = NULL;
+
+void print_profile(){
+	if (profiler)
+		profiler->Report(profiled_cpu);
+	profiler = NULL;
+}
+
+// Set while tracing, the last records are written out when the emulator exits
+Tracer* tracer = NULL;
+
+void stop_trace(){
+	if (tracer)
+		tracer->Stop();
+	tracer = NULL;
+}
+
 int main(int argc, char *argv[]){
-	// The cycle at which the emulator will start on (to make debugging less of a hassle)
-	size_t start_frame = 0;
+	// Where debug mode starts stepping from (to make debugging less of a hassle)
+	SeekTarget seek_target;
+	bool wrap_sprites = false;
+	uint16_t load_addr = ROM_START;
+	size_t ips = DEFAULT_IPS;
+	unsigned speed = 1;
+	unsigned turbo = DEFAULT_TURBO_SPEED;
+	bool use_jit = false;
+	const char* load_state = NULL;
+	int slot = 0;
+	size_t rewind_budget = REWIND_DEFAULT_BUDGET;
+	bool seeded = false;
+	uint32_t seed = 0;
+	bool profile = false;
+	const char* trace_path = NULL;
+	size_t audio_buffer = DEFAULT_AUDIO_BUFFER;
+	const char* keys_path = NULL;
 	int o;
 	int opt_index = 0;
 
@@ -40,13 +111,30 @@ int main(int argc, char *argv[]){
 		{"debug-mode", 	  optional_argument,  0, 'd'},
 		{"verbose",   optional_argument,  0, 'v'},
 		{"slow-mode",   no_argument,  0, 's'},
+		{"ips",   required_argument,  0, 'i'},
+		{"uncapped",   no_argument,  0, 'u'},
+		{"speed",   required_argument,  0, 'f'},
+		{"turbo",   required_argument,  0, 't'},
+		{"jit",   no_argument,  0, 'j'},
+		{"load-state",   required_argument,  0, 'l'},
+		{"slot",   required_argument,  0, 'n'},
+		{"profile",   no_argument,  0, 'P'},
+		{"trace",   required_argument,  0, 'T'},
+		{"record",   required_argument,  0, 'R'},
+		{"seed",   required_argument,  0, 'e'},
+		{"rewind-mb",   required_argument,  0, 'r'},
+		{"load-addr",   required_argument,  0, 'a'},
+		{"keys",   required_argument,  0, 'k'},
+		{"audio-buffer",   required_argument,  0, 'b'},
+		{"wrap-sprites",   no_argument,  0, 'w'},
 		{"help",   no_argument,  0, 'h'},
 		{0,0,0,0},
 	};
 
 	std::string rom_str;
+	std::string games_dir = DEFAULT_GAMES_DIR;
 
-	while ((o = getopt_long(argc, argv, "hsp:v::d::", long_opts, &opt_index)) != -1){
+	while ((o = getopt_long(argc, argv, "hsujPa:b:f:t:k:p:i:l:r:R:T:v::d::w", long_opts, &opt_index)) != -1){
 		switch (o){
 			// Debug mode
 			case 'd':
@@ -55,7 +143,11 @@ int main(int argc, char *argv[]){
 						&& argv[optind][0] != '-')
 					optarg = argv[optind++];
 
-				if (optarg) start_frame = std::atoi(optarg);
+				if (optarg && !ParseSeekTarget(optarg, &seek_target)){
+					printf("Invalid debug mode target \"%s\"\n", optarg);
+					help_menu();
+					exit(1);
+				}
 				printf("Running chip8 in debug mode...\n");
 				DEBUG_MODE = true;
 				break;
@@ -85,14 +177,71 @@ int main(int argc, char *argv[]){
 				break;
 			case 's':
 				SLOW_MODE = true;
+				ips = SLOW_MODE_IPS;
+				break;
+			case 'i':
+				ips = std::strtoull(optarg, NULL, 0);
+				// Frames of 0 instructions would never get anywhere
+				if (!ips){
+					printf("Invalid instructions per second \"%s\"\n", optarg);
+					help_menu();
+					exit(1);
+				}
+				break;
+			case 'u':
+				speed = 0;
+				break;
+			case 'f':
+				speed = std::strtoul(optarg, NULL, 0);
+				break;
+			case 't':
+				turbo = std::strtoul(optarg, NULL, 0);
+				break;
+			case 'j':
+				use_jit = true;
+				break;
+			case 'l':
+				load_state = optarg;
+				break;
+			case 'n':
+				slot = std::atoi(optarg);
+				break;
+			case 'P':
+				profile = true;
+				break;
+			case 'T':
+				trace_path = optarg;
+				break;
+			case 'R':
+				record_path = optarg;
+				break;
+			case 'e':
+				seed = std::strtoul(optarg, NULL, 0);
+				seeded = true;
+				break;
+			case 'r':
+				rewind_budget = std::strtoull(optarg, NULL, 0) << 20;
+				break;
+			case 'a':
+				// Anything past 0xFFFF is just as invalid, and LoadROM says so
+				load_addr = std::min(std::strtoul(optarg, NULL, 0), 0xFFFFUL);
+				break;
+			case 'k':
+				keys_path = optarg;
+				break;
+			case 'b':
+				audio_buffer = std::min(std::strtoul(optarg, NULL, 0), 0xFFFFUL);
+				break;
+			case 'w':
+				wrap_sprites = true;
 				break;
 			case 'h':
 				help_menu();
 				exit(0);
 				break;
 			case 'p':
-				// If path flag is passed, use its argument as the rom string
-				rom_str = SelectGame(optarg).c_str();
+				// Pick the game from this directory instead of the default one
+				games_dir = optarg;
 				break;
 			case '?':
 				printf("Error parsing arguments.\n");
@@ -104,11 +253,19 @@ int main(int argc, char *argv[]){
 		}
 	}
 
+	if (keys_path && !InputHandler::LoadKeyMap(keys_path))
+		return 1;
+	rom_str = SelectGame(games_dir);
 	if (rom_str == "")
-		rom_str = SelectGame(DEFAULT_GAMES_DIR).c_str();
+		return 1;
+	if (record_path && load_state){
+		printf("Recordings have to start from the beginning of the ROM, --record can't be used with --load-state\n");
+		return 1;
+	}
 	
 
 	Chip8 chip8;
+	chip8.wrap_sprites = wrap_sprites;
 	const char* rom_path = rom_str.c_str();
 	std::cout << std::string(rom_path) << std::endl;
 	// SDL Rendering stuff
@@ -121,7 +278,7 @@ int main(int argc, char *argv[]){
 			SDL_WINDOW_RESIZABLE
 		);
 
-	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
 	// Resolution-independent scaling
 	SDL_RenderSetLogicalSize(renderer, SCREEN_X, SCREEN_Y);
 	SDL_SetRenderDrawColor( renderer, 0, 0, 0, 0);
@@ -130,50 +287,207 @@ int main(int argc, char *argv[]){
 		printf("Error initializing SDL: %s\n", SDL_GetError());
 		return 0;
 	}
+	Beeper beeper;
+	if (audio_buffer)
+		beeper.Open(audio_buffer);
 
 	// Chip8 initialization & cycles
 	printf("===============START================\n");
 	Clock clock;
-	chip8.LoadROM(rom_path);
+	RomError err = chip8.LoadROM(rom_path, load_addr);
+	if (err != ROM_OK){
+		printf("Failed to load \"%s\": %s\n", rom_path, RomErrorString(err));
+		ExitChip8();
+	}
 	CPU cpu(&chip8, &clock);
-	Display disp(&chip8);
+	cpu.pc = load_addr;
+	Display disp(&chip8, renderer);
+	TerminalOutput terminal(&chip8);
+	if (VERBOSE_DISPLAY)
+		disp.terminal = &terminal;
+	SDLInput input(&chip8);
+	InputSource* source = &input;
+	if (record_path && !seeded)
+		seed = time(0);
+	if (record_path || seeded)
+		cpu.seed(seed);
+	InputRecorder keys_recorder(&cpu, &input);
+	if (record_path){
+		record_header.rom_hash = HashFile(rom_path);
+		record_header.ips = ips;
+		record_header.seed = seed;
+		record_header.wrap_sprites = wrap_sprites;
+		record_header.load_addr = load_addr;
+		recorder = &keys_recorder;
+		source = recorder;
+		std::atexit(save_recording);
+		printf("Recording to \"%s\", rewinding and loading states are off\n", record_path);
+		rewind_budget = 0;
+	}
 
-	bool quit = false;
-	size_t num_pixels = 0;	
-	// Each cycle is equivalent to one frame
+	Jit jit;
+	if (use_jit && jit.available())
+		cpu.jit = &jit;
+	Profiler cpu_profiler;
+	if (profile){
+		profiler = &cpu_profiler;
+		profiled_cpu = &cpu;
+		cpu.profiler = profiler;
+		std::atexit(print_profile);
+	}
+	// --trace records everything, -v cpu and -v clock only their part
+	Tracer cpu_tracer(&cpu);
+	if (trace_path || VERBOSE_CPU || VERBOSE_CLOCK){
+		if (!trace_path)
+			trace_path = DEFAULT_TRACE_PATH;
+		if (!cpu_tracer.Start(trace_path))
+			return 1;
+		tracer = &cpu_tracer;
+		if (VERBOSE_CPU || !VERBOSE_CLOCK)
+			cpu.tracer = tracer;
+		if (VERBOSE_CLOCK || !VERBOSE_CPU)
+			clock.tracer = tracer;
+		std::atexit(stop_trace);
+		printf("Tracing to \"%s\", decode it with chip8-trace\n", trace_path);
+	}
+	Scheduler sched(&cpu, &clock, ips);
+	// Speed 0 is uncapped
+	auto set_speed = [&](unsigned n){
+		sched.uncapped = (n == 0);
+		sched.speed = n;
+	};
+	set_speed(speed);
+	SaveState state;
+	if (load_state){
+		if (!ReadState(load_state, &state))
+			return 1;
+		RestoreState(&sched, &state);
+	}
+	std::string slot_path = StateSlotPath(rom_str, slot);
+	RewindBuffer history(rewind_budget);
+
+	std::atomic<bool> quit(false);
+	// Number of instructions executed so far
 	size_t cycles = 0;
-	// If running in debug mode, this while loop will bring us to the specified frame
-	if (start_frame){
-		printf("Jumping to frame %zu...\n", start_frame);
-		while(cycles < start_frame-1){
-			InputHandler::GetChip8Keys(&chip8);
-			cpu.cycle();
-			disp.RenderGFX(&num_pixels, renderer);
-			if (DEBUG_MODE)
-				printf("Cycles: %zu\n", cycles);
-
-			cpu.delay_timer();
-			clock.tick();
-			cycles++;
-		}
-		printf("Finished jumping to frame %zu.\n", start_frame);
+	// Debug mode runs straight to its target with nothing polled, drawn or waited for, then shows where it ended up
+	if (seek_target.kind != SeekTarget::NONE){
+		printf("Seeking...\n");
+		auto seek_start = std::chrono::steady_clock::now();
+		bool reached;
+		cycles += Seek(&sched, seek_target, &reached);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - seek_start;
+		if (reached)
+			printf("Reached the target after %zu cycles (frame %llu) in %.3fs\n", cycles,
+					(unsigned long long) sched.frames, elapsed.count());
+		else
+			printf("Gave up on the target after %zu cycles\n", cycles);
+		cpu.print_registers();
+		chip8.draw_flag = true;
+		disp.Present();
 	}
 
-	while(!quit){
-		InputHandler::GetChip8Keys(&chip8);
-		cycles++;
-		cpu.cycle();
-		disp.RenderGFX(&num_pixels, renderer);
-		if (DEBUG_MODE){
+	// Emulator hotkeys, checked once per frame (or step) by whichever thread runs the CPU
+	auto hotkeys = [&]{
+		if (VERBOSE_INPUT) InputHandler::PrintChip8Keys(&chip8);
+
+		if (InputHandler::HotkeyPressed(SDL_SCANCODE_F2) && profiler)
+			profiler->Report(&cpu);
+
+		// Save states
+		if (InputHandler::HotkeyPressed(SDL_SCANCODE_F5)){
+			CaptureState(&sched, &state);
+			if (WriteState(slot_path.c_str(), &state))
+				printf("Saved state to \"%s\"\n", slot_path.c_str());
+		}
+		if (InputHandler::HotkeyPressed(SDL_SCANCODE_F9) && !recorder){
+			if (ReadState(slot_path.c_str(), &state)){
+				RestoreState(&sched, &state);
+				printf("Loaded state from \"%s\"\n", slot_path.c_str());
+			}
+		}
+	};
+
+	if (DEBUG_MODE){
+		// Stepping stays on this thread, every instruction is shown before the next one runs
+		while(!quit){
+			quit = !InputHandler::PumpEvents();
+			source->PollKeys();
+			cycles += sched.Run(1);
+			disp.Present();
 			printf("Cycles: %zu\n", cycles);
 			// Execute each cycle only when pressing a valid chip8 key
 			InputHandler::WaitForKeyPress();
+			hotkeys();
 		}
-		cpu.delay_timer();
-		clock.tick();
-		if (VERBOSE_INPUT) InputHandler::PrintChip8Keys(&chip8);
+	} else {
+		/* The CPU runs on its own thread and hands every finished frame to this one through a triple buffer. This thread
+		 * owns SDL (it has to be the one that made the window): it pumps events and presents the newest frame, with
+		 * vsync pacing it to the display. Neither side ever waits for the other, a slow present can't hold up
+		 * emulation and frames the display had no time for are just skipped. */
+		TripleBuffer<Frame> frames;
+		std::thread emulation([&]{
+			// Achieved speed, measured over a second of real time and printed while it isn't meant to be 1x
+			auto speed_start = std::chrono::steady_clock::now();
+			uint64_t speed_frames = sched.frames;
+			bool speed_shown = false;
+			while(!quit){
+				// Fast-forward while tab is held
+				set_speed(InputHandler::HotkeyHeld(SDL_SCANCODE_TAB) ? turbo : speed);
+				source->PollKeys();
+				if (rewind_budget && InputHandler::HotkeyHeld(SDL_SCANCODE_BACKSPACE)){
+					// Step back one frame per tick for as long as backspace is held
+					history.StepBack(&cpu);
+					beeper.Set(false);
+				} else {
+					// One frame worth of instructions, then wait for the next 60Hz tick
+					cycles += sched.RunFrame();
+					if (rewind_budget)
+						history.Push(&cpu);
+					// The tone follows st at frame granularity, which is the granularity st counts down at anyway
+					beeper.Set(cpu.st > 0);
+				}
+				if (chip8.draw_flag){
+					chip8.draw_flag = false;
+					frames.Back().Capture(&chip8, sched.frames);
+					frames.Publish();
+				}
+				sched.WaitForFrame();
+				hotkeys();
+
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - speed_start;
+				if (elapsed.count() >= 1){
+					bool fast = sched.uncapped || sched.speed != 1;
+					// One more line once back to normal speed, so the last one printed isn't stale
+					if (fast || speed_shown)
+						printf("Speed: %.1fx (%.0f frames/sec)\n", (sched.frames - speed_frames) / elapsed.count() / 60,
+								(sched.frames - speed_frames) / elapsed.count());
+					speed_shown = fast;
+					speed_start = std::chrono::steady_clock::now();
+					speed_frames = sched.frames;
+				}
+			}
+		});
+
+		while(!quit){
+			// Waiting for events rather than sleeping, so input is picked up as soon as it arrives
+			if (!InputHandler::PumpEvents(1))
+				quit = true;
+			if (frames.Acquire())
+				disp.RenderFrame(frames.Front());
+			else if (disp.terminal)
+				disp.terminal->Flush();
+		}
+		emulation.join();
 	}
 
+	save_recording();
+	print_profile();
+	stop_trace();
+	if (VERBOSE_INPUT)
+		InputHandler::PrintLatency();
+	if (VERBOSE_CLOCK)
+		clock.print_stats();
+	beeper.Close();
 	SDL_DestroyWindow(window);
 	SDL_Quit();
 
@@ -0,0 +1,109 @@
+#include <profiler.h>
+#include <cpu.h>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+	// The opcode with its operands written as letters, e.g. 0x8124 -> "8xy4"
+	std::string pattern(uint16_t opcode){
+		char str[5];
+		snprintf(str, sizeof(str), "%04X", opcode);
+		const char* operands = "    ";
+		switch (opcode & 0xF000){
+			case 0x0000:
+				if ((opcode & 0xFFF0) == 0x00C0)
+					operands = "   n"; // 00Cn - SCD
+				else if (opcode != 0x00E0 && opcode != 0x00EE && (opcode < 0x00FB || opcode > 0x00FF))
+					operands = " nnn";
+				break;
+			case 0x1000: case 0x2000: case 0xA000: case 0xB000:
+				operands = " nnn";
+				break;
+			case 0x3000: case 0x4000: case 0x6000: case 0x7000: case 0xC000:
+				operands = " xkk";
+				break;
+			case 0x5000: case 0x8000: case 0x9000:
+				operands = " xy ";
+				break;
+			case 0xD000:
+				operands = " xyn";
+				break;
+			case 0xE000: case 0xF000:
+				operands = " x  ";
+				break;
+		}
+		for (int k = 1; k < 4; k++)
+			if (operands[k] != ' ')
+				str[k] = operands[k];
+		return str;
+	}
+
+	void print_percent(FILE* out, uint64_t count, uint64_t total){
+		fprintf(out, "%14llu %6.2f%%", (unsigned long long) count, total ? 100.0 * count / total : 0.0);
+	}
+
+	template<typename Key>
+	std::vector<std::pair<Key, uint64_t>> sorted(const std::map<Key, uint64_t>& counts, size_t top){
+		std::vector<std::pair<Key, uint64_t>> rows(counts.begin(), counts.end());
+		std::stable_sort(rows.begin(), rows.end(), [](const std::pair<Key, uint64_t>& a, const std::pair<Key, uint64_t>& b){
+			return a.second > b.second;
+		});
+		if (rows.size() > top)
+			rows.resize(top);
+		return rows;
+	}
+}
+
+void Profiler::Reset(){
+	memset(opcode_counts, 0, 0x10000 * sizeof(uint64_t));
+	memset(pc_counts, 0, sizeof(pc_counts));
+}
+
+void Profiler::Report(CPU* cpu, FILE* out, size_t top){
+	uint64_t total = 0;
+	std::map<std::string, uint64_t> ops;
+	std::map<std::string, uint64_t> patterns;
+	for (uint32_t opcode = 0; opcode <= 0xFFFF; opcode++){
+		uint64_t count = opcode_counts[opcode];
+		if (!count)
+			continue;
+		total += count;
+		ops[Op::optostr(cpu->decode(opcode))] += count;
+		patterns[pattern(opcode)] += count;
+	}
+
+	fprintf(out, "==============PROFILE===============\n");
+	fprintf(out, "%llu instructions\n", (unsigned long long) total);
+
+	fprintf(out, "\nBy instruction:\n");
+	for (const auto& row : sorted(ops, top)){
+		fprintf(out, "  %-6s", row.first.c_str());
+		print_percent(out, row.second, total);
+		fprintf(out, "\n");
+	}
+
+	fprintf(out, "\nBy opcode pattern:\n");
+	for (const auto& row : sorted(patterns, top)){
+		fprintf(out, "  %-6s", row.first.c_str());
+		print_percent(out, row.second, total);
+		fprintf(out, "\n");
+	}
+
+	// Hot addresses, with what is there now (which is what ran unless the ROM rewrote it)
+	std::map<uint16_t, uint64_t> pcs;
+	for (uint16_t pc = 0; pc < MEM_SIZE; pc++)
+		if (pc_counts[pc])
+			pcs[pc] = pc_counts[pc];
+	fprintf(out, "\nBy address:\n");
+	for (const auto& row : sorted(pcs, top)){
+		uint16_t opcode = cpu->mem[row.first] << 8 | cpu->mem[(row.first + 1) & (MEM_SIZE - 1)];
+		fprintf(out, "  0x%03X ", row.first);
+		print_percent(out, row.second, total);
+		fprintf(out, "  %04X %s\n", opcode, Op::optostr(cpu->decode(opcode)));
+	}
+	fprintf(out, "====================================\n");
+}
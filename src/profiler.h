@@ -0,0 +1,36 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chip8.h>
+#include <cstdio>
+
+class CPU;
+
+// Rows per table in Report
+#define PROFILE_TOP 20
+
+/* Execution counters filled in by CPU::cycle()
+ * Only two increments per instruction are done while running: one for the exact opcode and one for its address.
+ * Counts per Op kind and per opcode pattern (8xy4, Fx33, ...) are worked out from the opcode counts when reporting,
+ * so they stay right even for ROMs that rewrite their own code. */
+class Profiler {
+public:
+	Profiler() : opcode_counts(new uint64_t[0x10000]()) {}
+	~Profiler() { delete[] opcode_counts; }
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	void Count(uint16_t pc, uint16_t opcode){
+		opcode_counts[opcode]++;
+		pc_counts[pc & (MEM_SIZE - 1)]++;
+	}
+	void Reset();
+	// Print the most executed Op kinds, opcode patterns and addresses, most executed first
+	void Report(CPU* cpu, FILE* out = stdout, size_t top = PROFILE_TOP);
+
+private:
+	uint64_t* opcode_counts; // Indexed by opcode, a plain array since Count is on the hot path
+	uint64_t pc_counts[MEM_SIZE] = {0};
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,122 @@
+#include <replay.h>
+#include <savestate.h>
+
+/* File layout after the magic and version: the header fields, then events until the end marker. Each event is the
+ * number of cycles since the previous one (varint) and its type:
+ *   REPLAY_POLL  u16 bitmask of the keys held after a poll (only written when it changed)
+ *   REPLAY_END   u64 hash of the final state, the event's cycle is the last cycle of the session */
+#define REPLAY_POLL 0
+#define REPLAY_END 0xFF
+
+void InputRecorder::Event(uint8_t type){
+	events.varint(cpu->cycles - last_cycle);
+	events.u8(type);
+	last_cycle = cpu->cycles;
+}
+
+void InputRecorder::PollKeys(){
+	source->PollKeys();
+	uint16_t keys = 0;
+	for (int k = 0; k < NUM_KEYS; k++)
+		keys |= cpu->chip8->keys[k] << k;
+	if (keys != last_keys){
+		Event(REPLAY_POLL);
+		events.u16(keys);
+		last_keys = keys;
+	}
+}
+
+bool InputRecorder::Write(const char* path, const ReplayHeader& header){
+	Writer w;
+	w.bytes(REPLAY_MAGIC, 4);
+	w.u16(REPLAY_VERSION);
+	w.u64(header.rom_hash);
+	w.u32(header.ips);
+	w.u32(header.seed);
+	w.u8(header.wrap_sprites);
+	w.u16(header.load_addr);
+	w.bytes(events.buf.data(), events.buf.size());
+
+	SaveState state;
+	CaptureState(cpu, &state);
+	w.varint(cpu->cycles - last_cycle);
+	w.u8(REPLAY_END);
+	w.u64(HashState(&state));
+	return WriteFile(path, w.buf);
+}
+
+bool Replay::Load(const char* path){
+	std::vector<uint8_t> buf;
+	if (!ReadFile(path, buf))
+		return false;
+
+	Reader r = {buf.data(), buf.data() + buf.size()};
+	char magic[4];
+	r.bytes(magic, 4);
+	if (!r.ok || memcmp(magic, REPLAY_MAGIC, 4)){
+		printf("\"%s\" is not a recording\n", path);
+		return false;
+	}
+	uint16_t version = r.u16();
+	if (version != REPLAY_VERSION){
+		printf("Recording \"%s\" is version %u, expected %u\n", path, version, REPLAY_VERSION);
+		return false;
+	}
+	header.rom_hash = r.u64();
+	header.ips = r.u32();
+	header.seed = r.u32();
+	header.wrap_sprites = r.u8();
+	header.load_addr = r.u16();
+	if (r.ok && !header.ips){
+		printf("Recording \"%s\" is damaged: it runs at 0 instructions per second\n", path);
+		return false;
+	}
+
+	polls.clear();
+	uint64_t cycle = 0;
+	while (r.ok){
+		cycle += r.varint();
+		uint8_t type = r.u8();
+		if (type == REPLAY_POLL)
+			polls.push_back({cycle, r.u16()});
+		else if (type == REPLAY_END){
+			total_cycles = cycle;
+			final_hash = r.u64();
+			break;
+		} else {
+			printf("Recording \"%s\" has an unknown event type %u\n", path, type);
+			return false;
+		}
+	}
+	if (!r.ok){
+		printf("Recording \"%s\" is truncated\n", path);
+		return false;
+	}
+	next_poll = 0;
+	return true;
+}
+
+void Replay::PollKeys(){
+	while (next_poll < polls.size() && polls[next_poll].cycle <= cpu->cycles){
+		uint16_t keys = polls[next_poll++].keys;
+		for (int k = 0; k < NUM_KEYS; k++)
+			cpu->chip8->keys[k] = (keys >> k) & 1;
+	}
+}
+
+bool Replay::Run(Scheduler* sched){
+	cpu = sched->cpu;
+	// Run straight up to each poll instead of polling every frame, so keys change on exactly the recorded cycle
+	while (cpu->cycles < total_cycles){
+		PollKeys();
+		uint64_t stop = total_cycles;
+		if (next_poll < polls.size())
+			stop = std::min(stop, polls[next_poll].cycle);
+		sched->Run(stop - cpu->cycles);
+	}
+	PollKeys();
+
+	SaveState state;
+	CaptureState(cpu, &state);
+	return HashState(&state) == final_hash;
+}
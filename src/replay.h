@@ -0,0 +1,69 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <chip8.h>
+#include <cpu.h>
+#include <io.h>
+#include <scheduler.h>
+#include <binio.h>
+#include <vector>
+
+// Recording files start with this, followed by the format version
+#define REPLAY_MAGIC "C8RP"
+#define REPLAY_VERSION 4
+
+/* A session is reproducible from the ROM, the settings below and every key change the CPU saw. Keys only change when
+ * the frontend polls them (Fx0A waits on the polled keys too), so each poll that changed them is stored along with the
+ * cycle (CPU::cycles) it happened on. The end of the recording has the final cycle count and a hash of the final state to check a replay against. */
+struct ReplayHeader {
+	uint64_t rom_hash = 0; // FNV-1a of the ROM file, to catch replaying against the wrong ROM
+	uint32_t ips = DEFAULT_IPS;
+	uint32_t seed = 0;
+	bool wrap_sprites = false;
+	uint16_t load_addr = ROM_START;
+};
+
+// InputSource wrapper that passes keys through from another source and records every change
+class InputRecorder : public InputSource {
+public:
+	InputRecorder(CPU* cpu, InputSource* source) : cpu(cpu), source(source) {}
+
+	void PollKeys() override;
+	// Write the recording so far, ending at the CPU's current cycle and state
+	bool Write(const char* path, const ReplayHeader& header);
+
+private:
+	CPU* cpu;
+	InputSource* source;
+	uint16_t last_keys = 0; // Key state as of the last recorded change, one bit per key
+	uint64_t last_cycle = 0; // Cycle of the last event, events store the difference
+	Writer events;
+
+	void Event(uint8_t type);
+};
+
+// InputSource that plays a recording back, giving the CPU the same keys on the same cycles
+class Replay : public InputSource {
+public:
+	ReplayHeader header;
+	uint64_t total_cycles = 0;
+	uint64_t final_hash = 0;
+
+	bool Load(const char* path);
+	// Runs the recording on sched's CPU (which should have the ROM loaded and header's settings applied) as fast as the
+	// host allows. Returns true if the final state matches the recorded one.
+	bool Run(Scheduler* sched);
+
+	void PollKeys() override;
+
+private:
+	struct KeyEvent {
+		uint64_t cycle;
+		uint16_t keys; // Bitmask of the keys held
+	};
+	std::vector<KeyEvent> polls;
+	size_t next_poll = 0;
+	CPU* cpu = nullptr;
+};
+
+#endif // REPLAY_H
@@ -0,0 +1,130 @@
+#include <rewind.h>
+#include <cstring>
+
+/* Delta format: a sequence of [zero run length][literal length][literal bytes], lengths as LEB128 varints.
+ * The zero runs are bytes that didn't change, the literals are XORed into the previous state. */
+
+namespace {
+	void put_varint(std::vector<uint8_t>& out, size_t x){
+		while (x >= 0x80){
+			out.push_back((x & 0x7F) | 0x80);
+			x >>= 7;
+		}
+		out.push_back(x);
+	}
+
+	size_t get_varint(const uint8_t*& p){
+		size_t x = 0;
+		int shift = 0;
+		while (*p & 0x80){
+			x |= (size_t)(*p++ & 0x7F) << shift;
+			shift += 7;
+		}
+		x |= (size_t)(*p++) << shift;
+		return x;
+	}
+}
+
+RewindBuffer::RewindBuffer(size_t budget_bytes, size_t keyframe_interval)
+	: budget(budget_bytes), keyframe_interval(keyframe_interval) {}
+
+void RewindBuffer::EncodeDelta(const uint8_t* a, const uint8_t* b, size_t len, std::vector<uint8_t>& out){
+	size_t pos = 0;
+	while (pos < len){
+		size_t zeros = 0;
+		while (pos + zeros < len && a[pos + zeros] == b[pos + zeros])
+			zeros++;
+		pos += zeros;
+		// Literal runs end at the next pair of unchanged bytes, a single unchanged byte is cheaper to keep inline
+		size_t lit = 0;
+		while (pos + lit < len && !(a[pos + lit] == b[pos + lit]
+					&& (pos + lit + 1 >= len || a[pos + lit + 1] == b[pos + lit + 1])))
+			lit++;
+		if (!lit)
+			break; // Only unchanged bytes were left
+		put_varint(out, zeros);
+		put_varint(out, lit);
+		for (size_t k = 0; k < lit; k++)
+			out.push_back(a[pos + k] ^ b[pos + k]);
+		pos += lit;
+	}
+}
+
+void RewindBuffer::ApplyDelta(uint8_t* state, const std::vector<uint8_t>& delta){
+	const uint8_t* p = delta.data();
+	const uint8_t* end = p + delta.size();
+	size_t pos = 0;
+	while (p < end){
+		pos += get_varint(p);
+		size_t lit = get_varint(p);
+		for (size_t k = 0; k < lit; k++)
+			state[pos++] ^= *p++;
+	}
+}
+
+size_t RewindBuffer::EntrySize(const Entry& entry){
+	return sizeof(Entry) + (entry.keyframe ? sizeof(SaveState) : entry.delta.capacity());
+}
+
+void RewindBuffer::Push(const CPU* cpu){
+	Entry entry;
+	if (entries.empty() || since_keyframe + 1 >= keyframe_interval){
+		entry.keyframe.reset(new SaveState);
+		CaptureState(cpu, entry.keyframe.get());
+		memcpy(&current, entry.keyframe.get(), sizeof(SaveState));
+		since_keyframe = 0;
+	} else {
+		SaveState next;
+		CaptureState(cpu, &next);
+		EncodeDelta((const uint8_t*) &next, (const uint8_t*) &current, sizeof(SaveState), entry.delta);
+		entry.delta.shrink_to_fit();
+		memcpy(&current, &next, sizeof(SaveState));
+		since_keyframe++;
+	}
+	bytes += EntrySize(entry);
+	entries.push_back(std::move(entry));
+
+	// Never drop the segment that is still being filled
+	while (bytes > budget && entries.size() > keyframe_interval)
+		DropOldest();
+}
+
+void RewindBuffer::DropOldest(){
+	// Drop the oldest keyframe along with every delta up to the next keyframe
+	do {
+		bytes -= EntrySize(entries.front());
+		entries.pop_front();
+	} while (!entries.empty() && !entries.front().keyframe);
+}
+
+bool RewindBuffer::StepBack(CPU* cpu){
+	if (entries.size() < 2)
+		return false;
+
+	Entry newest = std::move(entries.back());
+	entries.pop_back();
+	bytes -= EntrySize(newest);
+
+	if (!newest.keyframe){
+		// XOR is its own inverse, so applying the newest delta again gives the frame before it
+		ApplyDelta((uint8_t*) &current, newest.delta);
+		since_keyframe--;
+	} else {
+		// The frame before a keyframe has to be rebuilt from the previous keyframe
+		size_t k = entries.size() - 1;
+		while (!entries[k].keyframe)
+			k--;
+		memcpy(&current, entries[k].keyframe.get(), sizeof(SaveState));
+		for (size_t e = k + 1; e < entries.size(); e++)
+			ApplyDelta((uint8_t*) &current, entries[e].delta);
+		since_keyframe = entries.size() - 1 - k;
+	}
+	RestoreState(cpu, &current);
+	return true;
+}
+
+void RewindBuffer::Clear(){
+	entries.clear();
+	bytes = 0;
+	since_keyframe = 0;
+}
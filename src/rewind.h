@@ -0,0 +1,54 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <savestate.h>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Frames between full snapshots
+#define REWIND_KEYFRAME_INTERVAL 60
+// Default memory budget, roughly 5 minutes of history for most ROMs
+#define REWIND_DEFAULT_BUDGET (4 << 20)
+
+/* Rewind history, one entry per frame
+ * Every REWIND_KEYFRAME_INTERVAL frames a full SaveState is kept (a keyframe). The frames in between only store the
+ * run-length encoded XOR of their SaveState against the frame before, which is a few dozen bytes for most frames since
+ * only registers and a handful of mem/gfx bytes change. Stepping back XORs the newest delta out of the current state;
+ * only crossing a keyframe needs the previous keyframe's deltas replayed forward. Once the budget is exceeded the
+ * oldest keyframe and its deltas are dropped together. */
+class RewindBuffer {
+public:
+	RewindBuffer(size_t budget_bytes = REWIND_DEFAULT_BUDGET, size_t keyframe_interval = REWIND_KEYFRAME_INTERVAL);
+
+	// Record the machine state at the end of a frame
+	void Push(const CPU* cpu);
+	// Go back one frame: drops the newest entry and restores the one before it. False if there is nothing to go back to.
+	bool StepBack(CPU* cpu);
+	void Clear();
+
+	size_t Frames() const { return entries.size(); }
+	size_t Bytes() const { return bytes; }
+
+private:
+	struct Entry {
+		std::unique_ptr<SaveState> keyframe; // Set for keyframes
+		std::vector<uint8_t> delta; // RLE of the XOR against the previous frame, for everything else
+	};
+
+	size_t budget;
+	size_t keyframe_interval;
+	size_t since_keyframe = 0; // Frames pushed since the newest keyframe
+	size_t bytes = 0;
+	std::deque<Entry> entries;
+	SaveState current{}; // The newest entry's state, decoded. Only ever copied with memcpy so its padding stays zero
+
+	static size_t EntrySize(const Entry& entry);
+	// XOR len bytes of a and b and run-length encode the result into out
+	static void EncodeDelta(const uint8_t* a, const uint8_t* b, size_t len, std::vector<uint8_t>& out);
+	// XOR an encoded delta into state
+	static void ApplyDelta(uint8_t* state, const std::vector<uint8_t>& delta);
+	void DropOldest();
+};
+
+#endif // REWIND_H
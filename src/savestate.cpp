@@ -0,0 +1,182 @@
+#include <savestate.h>
+#include <binio.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+void CaptureState(const CPU* cpu, SaveState* state){
+	const Chip8* chip8 = cpu->chip8;
+	// Padding too, rewind deltas compare states byte for byte
+	memset(state, 0, sizeof(SaveState));
+	memcpy(state->mem, chip8->mem, sizeof(state->mem));
+	memcpy(state->gfx, chip8->gfx, sizeof(state->gfx));
+	state->hires = chip8->hires;
+	memcpy(state->keys, chip8->keys, sizeof(state->keys));
+	memcpy(state->v, cpu->v, sizeof(state->v));
+	memcpy(state->rpl, cpu->rpl, sizeof(state->rpl));
+	state->i = cpu->i;
+	state->pc = cpu->pc;
+	state->dt = cpu->dt;
+	state->st = cpu->st;
+	memcpy(state->stack, cpu->stack, sizeof(state->stack));
+	state->sp = cpu->sp;
+	state->rng_state = cpu->rng_state;
+	state->key_wait = cpu->key_wait;
+	state->key_wait_held = cpu->key_wait_held;
+	state->key_wait_pressed = cpu->key_wait_pressed;
+	state->cycles = cpu->cycles;
+}
+
+void RestoreState(CPU* cpu, const SaveState* state){
+	Chip8* chip8 = cpu->chip8;
+	memcpy(chip8->mem, state->mem, sizeof(state->mem));
+	memcpy(chip8->gfx, state->gfx, sizeof(state->gfx));
+	chip8->hires = state->hires;
+	memcpy(chip8->keys, state->keys, sizeof(state->keys));
+	memcpy(cpu->v, state->v, sizeof(state->v));
+	memcpy(cpu->rpl, state->rpl, sizeof(state->rpl));
+	cpu->i = state->i;
+	cpu->pc = state->pc;
+	cpu->dt = state->dt;
+	cpu->st = state->st;
+	memcpy(cpu->stack, state->stack, sizeof(state->stack));
+	cpu->sp = state->sp;
+	cpu->rng_state = state->rng_state;
+	cpu->key_wait = state->key_wait;
+	cpu->key_wait_held = state->key_wait_held;
+	cpu->key_wait_pressed = state->key_wait_pressed;
+	cpu->cycles = state->cycles;
+	cpu->flush_icache();
+	chip8->draw_flag = true;
+}
+
+void CaptureState(const Scheduler* sched, SaveState* state){
+	CaptureState(sched->cpu, state);
+	state->has_frame = true;
+	state->frames = sched->frames;
+	state->frame_cycles_left = sched->FrameCyclesLeft();
+}
+
+void RestoreState(Scheduler* sched, const SaveState* state){
+	RestoreState(sched->cpu, state);
+	if (state->has_frame)
+		sched->Resume(state->frames, state->frame_cycles_left);
+	else
+		sched->Resume(sched->frames);
+}
+
+namespace {
+	void write_fields(Writer& w, const SaveState* state){
+		w.bytes(state->mem, MEM_SIZE);
+		for (int y = 0; y < HIRES_Y; y++)
+			for (int word = 0; word < GFX_WORDS; word++)
+				w.u64(state->gfx[y][word]);
+		w.u8(state->hires);
+		for (int k = 0; k < NUM_KEYS; k++)
+			w.u8(state->keys[k]);
+		w.bytes(state->v, NUM_VREGS);
+		w.u16(state->i);
+		w.u16(state->pc);
+		w.u8(state->dt);
+		w.u8(state->st);
+		for (int s = 0; s < STACK_SIZE; s++)
+			w.u16(state->stack[s]);
+		w.u8(state->sp);
+		w.u32(state->rng_state);
+		w.bytes(state->rpl, NUM_RPL);
+		w.u8(state->key_wait);
+		w.u16(state->key_wait_held);
+		w.u16(state->key_wait_pressed);
+	}
+}
+
+uint64_t HashState(const SaveState* state){
+	Writer w;
+	write_fields(w, state);
+	uint64_t hash = 0xcbf29ce484222325; // FNV offset basis
+	for (uint8_t byte : w.buf){
+		hash ^= byte;
+		hash *= 0x100000001b3; // FNV prime
+	}
+	return hash;
+}
+
+bool WriteState(const char* path, const SaveState* state){
+	Writer w;
+	w.bytes(SAVESTATE_MAGIC, 4);
+	w.u16(SAVESTATE_VERSION);
+	write_fields(w, state);
+	w.u64(state->cycles);
+	w.u8(state->has_frame);
+	w.u64(state->frames);
+	w.u32(state->frame_cycles_left);
+	return WriteFile(path, w.buf);
+}
+
+bool ReadState(const char* path, SaveState* state){
+	std::vector<uint8_t> buf;
+	if (!ReadFile(path, buf))
+		return false;
+
+	Reader r = {buf.data(), buf.data() + buf.size()};
+	char magic[4];
+	r.bytes(magic, 4);
+	if (!r.ok || memcmp(magic, SAVESTATE_MAGIC, 4)){
+		printf("\"%s\" is not a save state\n", path);
+		return false;
+	}
+	uint16_t version = r.u16();
+	// Version 1 predates SUPER-CHIP, it only has the 64x32 screen and no RPL flags. Versions before 3 have no Fx0A
+	// wait state, an Fx0A that was waiting starts waiting again. Versions before 4 have no cycle count or frame position
+	// and resume at the start of a frame.
+	if (version < 1 || version > SAVESTATE_VERSION){
+		printf("Save state \"%s\" is version %u, expected %u\n", path, version, SAVESTATE_VERSION);
+		return false;
+	}
+
+	SaveState loaded = {};
+	r.bytes(loaded.mem, MEM_SIZE);
+	if (version == 1){
+		for (int y = 0; y < DISP_Y; y++)
+			loaded.gfx[y][0] = r.u64();
+	} else {
+		for (int y = 0; y < HIRES_Y; y++)
+			for (int word = 0; word < GFX_WORDS; word++)
+				loaded.gfx[y][word] = r.u64();
+		loaded.hires = r.u8();
+	}
+	for (int k = 0; k < NUM_KEYS; k++)
+		loaded.keys[k] = r.u8();
+	r.bytes(loaded.v, NUM_VREGS);
+	loaded.i = r.u16();
+	loaded.pc = r.u16();
+	loaded.dt = r.u8();
+	loaded.st = r.u8();
+	for (int s = 0; s < STACK_SIZE; s++)
+		loaded.stack[s] = r.u16();
+	loaded.sp = r.u8();
+	loaded.rng_state = r.u32();
+	if (version >= 2)
+		r.bytes(loaded.rpl, NUM_RPL);
+	if (version >= 3){
+		loaded.key_wait = r.u8();
+		loaded.key_wait_held = r.u16();
+		loaded.key_wait_pressed = r.u16();
+	}
+	if (version >= 4){
+		loaded.cycles = r.u64();
+		loaded.has_frame = r.u8();
+		loaded.frames = r.u64();
+		loaded.frame_cycles_left = r.u32();
+	}
+	if (!r.ok){
+		printf("Save state \"%s\" is truncated\n", path);
+		return false;
+	}
+	*state = loaded;
+	return true;
+}
+
+std::string StateSlotPath(const std::string& rom_path, int slot){
+	return rom_path + ".state" + std::to_string(slot);
+}
@@ -0,0 +1,60 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <chip8.h>
+#include <cpu.h>
+#include <scheduler.h>
+#include <string>
+
+// Save state files start with this, followed by the format version
+#define SAVESTATE_MAGIC "C8SS"
+#define SAVESTATE_VERSION 4
+
+// Full machine state. Capturing or restoring it is a handful of memcpys, files are only involved in Write/ReadState.
+struct SaveState {
+	// Chip8
+	uint8_t mem[MEM_SIZE];
+	uint64_t gfx[HIRES_Y][GFX_WORDS];
+	bool hires;
+	bool keys[NUM_KEYS];
+	// CPU
+	uint8_t v[NUM_VREGS];
+	uint16_t i;
+	uint16_t pc;
+	uint8_t dt;
+	uint8_t st;
+	uint16_t stack[STACK_SIZE];
+	uint8_t sp;
+	uint32_t rng_state;
+	uint8_t rpl[NUM_RPL];
+	bool key_wait;
+	uint16_t key_wait_held;
+	uint16_t key_wait_pressed;
+	uint64_t cycles; // CPU::cycles
+	// Where the scheduler was, so a state taken part way through a frame finishes that frame and ticks the timers
+	// where it would have. Not in states before version 4, those start a new frame.
+	bool has_frame;
+	uint64_t frames;
+	uint32_t frame_cycles_left;
+};
+
+// Copy the machine into state, padding bytes are zeroed so equal machines give byte-identical states
+void CaptureState(const CPU* cpu, SaveState* state);
+// Copy state back into the machine. Cached and compiled instructions are dropped since mem changed under them.
+void RestoreState(CPU* cpu, const SaveState* state);
+// Same, plus the scheduler's position in the current frame. Use these wherever a state can be taken mid-frame.
+void CaptureState(const Scheduler* sched, SaveState* state);
+void RestoreState(Scheduler* sched, const SaveState* state);
+
+// Serialize to/from a versioned binary file, all multi-byte values are little-endian
+bool WriteState(const char* path, const SaveState* state);
+bool ReadState(const char* path, SaveState* state);
+
+// FNV-1a hash of a state's serialized form, equal states always hash the same. The cycle count and frame position
+// are left out, so recordings made before they were saved still check out.
+uint64_t HashState(const SaveState* state);
+
+// File name used for save slot n of a ROM
+std::string StateSlotPath(const std::string& rom_path, int slot);
+
+#endif // SAVESTATE_H
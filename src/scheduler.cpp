@@ -0,0 +1,46 @@
+#include <scheduler.h>
+
+Scheduler::Scheduler(CPU* cpu, Clock* clock, size_t ips) : cpu(cpu), clock(clock), ips(ips) {
+	NextFrame();
+}
+
+void Scheduler::SetIPS(size_t ips){
+	this->ips = ips;
+}
+
+// Frame n gets floor((n+1) * ips / 60) - floor(n * ips / 60) instructions, which adds up to exactly ips every 60 frames
+void Scheduler::NextFrame(){
+	frame_cycles_left = ((frames + 1) * ips) / 60 - (frames * ips) / 60;
+}
+
+void Scheduler::Resume(uint64_t frames, size_t frame_cycles_left){
+	this->frames = frames;
+	NextFrame();
+	if (frame_cycles_left != SIZE_MAX)
+		this->frame_cycles_left = frame_cycles_left;
+	frame_done = false;
+}
+
+size_t Scheduler::Run(size_t max_cycles){
+	size_t cycles = cpu->run(std::min(frame_cycles_left, max_cycles));
+	frame_cycles_left -= cycles;
+	frame_done = (frame_cycles_left == 0);
+	if (frame_done){
+		cpu->tick_timers();
+		frames++;
+		NextFrame();
+	}
+	return cycles;
+}
+
+void Scheduler::WaitForFrame(){
+	if (uncapped){
+		clock->tick();
+		return;
+	}
+	// Sped up, the timers still count every frame but only every speed'th frame waits
+	if (++frames_this_tick < speed)
+		return;
+	frames_this_tick = 0;
+	clock->wait_tick();
+}
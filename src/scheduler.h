@@ -0,0 +1,57 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <chip8.h>
+#include <cpu.h>
+#include <clock.h>
+
+// Default instructions per second, CYCLES_PER_FRAME instructions every 60Hz tick
+#define DEFAULT_IPS (CYCLES_PER_FRAME * 60)
+// Instructions per second in SLOW_MODE
+#define SLOW_MODE_IPS 30
+// Speed while fast-forwarding, 0 is as fast as the host allows
+#define DEFAULT_TURBO_SPEED 0
+
+/* Decides when instructions run and when the timers tick
+ * Emulated time is split into 60Hz frames. Every frame runs ips/60 instructions (spread evenly when ips isn't a
+ * multiple of 60) and then counts dt and st down by one, so the timers always run at 60Hz of emulated time no matter
+ * how fast the host is. Real time is only involved in WaitForFrame, which keeps frames at 60Hz (or speed times that) unless
+ * uncapped. */
+class Scheduler {
+public:
+	CPU* cpu;
+	Clock* clock;
+	bool uncapped = false; // Run frames back to back instead of waiting for the next tick
+	unsigned speed = 1; // Frames per 60Hz tick when not uncapped
+	uint64_t frames = 0; // Frames completed so far
+
+	Scheduler(CPU* cpu, Clock* clock, size_t ips = DEFAULT_IPS);
+
+	void SetIPS(size_t ips);
+	size_t GetIPS() const { return ips; }
+
+	// Runs instructions until the current frame is done or max_cycles have run, ticking the timers when the frame ends.
+	// Returns the number of instructions executed.
+	size_t Run(size_t max_cycles);
+	// Runs the rest of the current frame
+	size_t RunFrame() { return Run(SIZE_MAX); }
+	// True if the last Run call finished a frame
+	bool FrameDone() const { return frame_done; }
+	// Instructions the current frame still has to run
+	size_t FrameCyclesLeft() const { return frame_cycles_left; }
+	// Carry on from a save state: frames completed so far and what's left of the current one (a whole new frame if not given)
+	void Resume(uint64_t frames, size_t frame_cycles_left = SIZE_MAX);
+	// Sleeps until the next 60Hz tick once every speed frames, returns straight away if uncapped
+	void WaitForFrame();
+
+private:
+	size_t ips;
+	size_t frame_cycles_left; // Instructions left to run in the current frame
+	bool frame_done = false;
+	unsigned frames_this_tick = 0; // Frames run since the last wait
+
+	// Start the next frame, works out how many instructions it gets
+	void NextFrame();
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,130 @@
+#include <seek.h>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+	// Whole string as a number (decimal, 0x hex or 0 octal)
+	bool ParseNumber(const char* str, uint64_t* value){
+		if (!*str)
+			return false;
+		char* end;
+		*value = std::strtoull(str, &end, 0);
+		return !*end;
+	}
+
+	bool ParseReg(std::string name, SeekTarget* target){
+		for (char& c : name)
+			c = tolower(c);
+		if (name.size() == 2 && name[0] == 'v' && isxdigit(name[1])){
+			target->reg = SeekTarget::REG_V;
+			target->x = std::strtoul(name.c_str() + 1, NULL, 16);
+			return true;
+		}
+		const struct { const char* name; SeekTarget::Reg reg; } regs[] = {
+			{"i", SeekTarget::REG_I}, {"pc", SeekTarget::REG_PC}, {"sp", SeekTarget::REG_SP},
+			{"dt", SeekTarget::REG_DT}, {"st", SeekTarget::REG_ST},
+		};
+		for (const auto& r : regs){
+			if (name == r.name){
+				target->reg = r.reg;
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+bool ParseSeekTarget(const char* str, SeekTarget* target){
+	*target = SeekTarget();
+	if (ParseNumber(str, &target->count)){
+		target->kind = SeekTarget::CYCLES;
+		return true;
+	}
+	if (strncmp(str, "cycles=", 7) == 0){
+		target->kind = SeekTarget::CYCLES;
+		return ParseNumber(str + 7, &target->count);
+	}
+	if (strncmp(str, "frame=", 6) == 0){
+		target->kind = SeekTarget::FRAME;
+		return ParseNumber(str + 6, &target->count);
+	}
+
+	// <reg><op><value>, two character operators have to be tried first
+	const struct { const char* text; SeekTarget::Op op; } ops[] = {
+		{"==", SeekTarget::EQ}, {"!=", SeekTarget::NE}, {"<=", SeekTarget::LE}, {">=", SeekTarget::GE},
+		{"=", SeekTarget::EQ}, {"<", SeekTarget::LT}, {">", SeekTarget::GT},
+	};
+	size_t split = strcspn(str, "=!<>");
+	if (!str[split])
+		return false;
+	for (const auto& o : ops){
+		size_t len = strlen(o.text);
+		if (strncmp(str + split, o.text, len) != 0)
+			continue;
+		uint64_t value;
+		if (!ParseReg(std::string(str, split), target) || !ParseNumber(str + split + len, &value) || value > 0xFFFF)
+			return false;
+		target->kind = SeekTarget::CONDITION;
+		target->op = o.op;
+		target->value = value;
+		return true;
+	}
+	return false;
+}
+
+bool SeekTarget::Holds(const CPU* cpu) const {
+	uint32_t reg_value = 0;
+	switch (reg){
+		case REG_V: reg_value = cpu->v[x]; break;
+		case REG_I: reg_value = cpu->i; break;
+		case REG_PC: reg_value = cpu->pc; break;
+		case REG_SP: reg_value = cpu->sp; break;
+		case REG_DT: reg_value = cpu->dt; break;
+		case REG_ST: reg_value = cpu->st; break;
+	}
+	switch (op){
+		case EQ: return reg_value == value;
+		case NE: return reg_value != value;
+		case LT: return reg_value < value;
+		case LE: return reg_value <= value;
+		case GT: return reg_value > value;
+		case GE: return reg_value >= value;
+	}
+	return false;
+}
+
+size_t Seek(Scheduler* sched, const SeekTarget& target, bool* reached, uint64_t max_cycles){
+	CPU* cpu = sched->cpu;
+	size_t cycles = 0;
+	*reached = false;
+	switch (target.kind){
+		case SeekTarget::NONE:
+			*reached = true;
+			break;
+		case SeekTarget::CYCLES:
+			// Whole frames at a time, through the JIT when there is one
+			while (cycles < target.count)
+				cycles += sched->Run(target.count - cycles);
+			*reached = true;
+			break;
+		case SeekTarget::FRAME:
+			while (sched->frames < target.count && cycles < max_cycles)
+				cycles += sched->RunFrame();
+			*reached = sched->frames >= target.count;
+			break;
+		case SeekTarget::CONDITION: {
+			// The condition is checked after every instruction, the JIT would run whole blocks past it
+			Jit* jit = cpu->jit;
+			cpu->jit = nullptr;
+			while (cycles < max_cycles && !*reached){
+				cycles += sched->Run(1);
+				*reached = target.Holds(cpu);
+			}
+			cpu->jit = jit;
+			break;
+		}
+	}
+	return cycles;
+}
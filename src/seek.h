@@ -0,0 +1,38 @@
+#ifndef SEEK_H
+#define SEEK_H
+
+#include <scheduler.h>
+
+// Instructions a seek runs before giving up on a condition that never comes true
+#define SEEK_MAX_CYCLES 200000000ULL
+
+/* Where --debug-mode starts stepping from, parsed from its argument:
+ *   <n> or cycles=<n>   after n instructions
+ *   frame=<n>           at the start of frame n
+ *   <reg><op><value>    once the condition holds after an instruction. reg is v0-vf, i, pc, sp, dt or st, op is one
+ *                       of == = != < <= > >=, e.g. pc=0x2A4 or v3>=10 */
+struct SeekTarget {
+	enum Kind { NONE, CYCLES, FRAME, CONDITION };
+	enum Reg { REG_V, REG_I, REG_PC, REG_SP, REG_DT, REG_ST };
+	enum Op { EQ, NE, LT, LE, GT, GE };
+
+	Kind kind = NONE;
+	uint64_t count = 0; // CYCLES/FRAME
+	Reg reg = REG_V;
+	uint8_t x = 0; // Which Vx for REG_V
+	Op op = EQ;
+	uint32_t value = 0;
+
+	// True if the CPU's state satisfies a CONDITION target
+	bool Holds(const CPU* cpu) const;
+};
+
+// False if str isn't one of the forms above
+bool ParseSeekTarget(const char* str, SeekTarget* target);
+
+// Runs the scheduler's CPU up to the target as fast as possible: no input, no output and no waiting for frames, the
+// timers still tick every frame. Returns the number of instructions run, sets *reached if the target was reached
+// within max_cycles.
+size_t Seek(Scheduler* sched, const SeekTarget& target, bool* reached, uint64_t max_cycles = SEEK_MAX_CYCLES);
+
+#endif // SEEK_H
@@ -0,0 +1,98 @@
+#include <terminal.h>
+#include <cstring>
+
+namespace {
+	// Indexed by (top << 1) | bottom
+	const char* half_blocks[4] = {" ", "▄", "▀", "█"};
+
+	bool pixel(const uint64_t (*gfx)[GFX_WORDS], int x, int y){
+		return (gfx[y][x / 64] >> (63 - x % 64)) & 1;
+	}
+}
+
+TerminalOutput::~TerminalOutput(){
+	if (!started)
+		return;
+	if (pending){
+		last_frame = {};
+		Flush();
+	}
+	int rows = (shown_hires ? HIRES_Y : DISP_Y) / 2;
+	// Below the frame with the cursor back on
+	fprintf(out, "\x1b[%d;1H\x1b[?25h\n", rows + 1);
+	fflush(out);
+}
+
+void TerminalOutput::MoveTo(int row, int col){
+	// Terminal rows and columns count from 1
+	buf += "\x1b[";
+	buf += std::to_string(row + 1);
+	buf += ';';
+	buf += std::to_string(col + 1);
+	buf += 'H';
+}
+
+bool TerminalOutput::Due(std::chrono::steady_clock::time_point now) const {
+	return !started || max_fps <= 0 || now - last_frame >= std::chrono::duration<double>(1.0 / max_fps);
+}
+
+void TerminalOutput::Flush(){
+	if (pending && Due(std::chrono::steady_clock::now()))
+		Draw(pending_gfx, pending_hires);
+}
+
+void TerminalOutput::Draw(const uint64_t (*gfx)[GFX_WORDS], bool hires){
+	auto now = std::chrono::steady_clock::now();
+	if (!Due(now)){
+		memcpy(pending_gfx, gfx, sizeof(pending_gfx));
+		pending_hires = hires;
+		pending = true;
+		return;
+	}
+	last_frame = now;
+	pending = false;
+
+	int width = hires ? HIRES_X : DISP_X;
+	int height = hires ? HIRES_Y : DISP_Y;
+	buf.clear();
+	bool redraw = !started || hires != shown_hires;
+	if (redraw){
+		// Hide the cursor and start from a blank screen, every lit cell gets drawn below
+		buf += "\x1b[?25l\x1b[2J";
+		for (int y = 0; y < HIRES_Y; y++)
+			for (int word = 0; word < GFX_WORDS; word++)
+				shown[y][word] = 0;
+		shown_hires = hires;
+		started = true;
+	}
+
+	// Where the cursor is after the last character, so runs of changed cells only need one move
+	int cursor_row = -1, cursor_col = -1;
+	for (int row = 0; row < height / 2; row++){
+		int top = row * 2, bottom = top + 1;
+		for (int word = 0; word < width / 64; word++){
+			// Bits set for the columns where either pixel of the cell changed
+			uint64_t changed = (gfx[top][word] ^ shown[top][word]) | (gfx[bottom][word] ^ shown[bottom][word]);
+			// A blank screen only needs its lit cells drawn
+			if (redraw)
+				changed = gfx[top][word] | gfx[bottom][word];
+			while (changed){
+				int bit = __builtin_clzll(changed);
+				changed &= ~(1ULL << (63 - bit));
+				int col = word * 64 + bit;
+				if (row != cursor_row || col != cursor_col)
+					MoveTo(row, col);
+				buf += half_blocks[pixel(gfx, col, top) << 1 | pixel(gfx, col, bottom)];
+				cursor_row = row;
+				cursor_col = col + 1;
+			}
+			shown[top][word] = gfx[top][word];
+			shown[bottom][word] = gfx[bottom][word];
+		}
+	}
+	if (buf.empty())
+		return;
+	fwrite(buf.data(), 1, buf.size(), out);
+	fflush(out);
+	bytes_written += buf.size();
+}
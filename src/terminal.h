@@ -0,0 +1,55 @@
+#ifndef TERMINAL_H
+#define TERMINAL_H
+
+#include <chip8.h>
+#include <io.h>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// Frames written per second at most, frames in between are skipped (their changes go out with the next one, or by
+// themselves once it's been long enough if nothing else gets drawn)
+#define TERMINAL_FPS 30
+
+/* Draws the framebuffer in a terminal with ANSI escapes, for watching a session over SSH
+ * Every character cell holds two pixels stacked on top of each other as a half block (top, bottom, both or neither),
+ * so the 64x32 screen fits in 64x16 cells and the 128x64 one in 128x32. Only cells that changed since the last frame
+ * written are sent, each run of them after one cursor move, and the whole frame goes out as a single write. A game that
+ * only moves a few sprites costs a few dozen bytes a frame instead of the whole screen. */
+class TerminalOutput : public OutputSink {
+public:
+	Chip8* chip8;
+	FILE* out;
+	double max_fps;
+	uint64_t bytes_written = 0; // Escapes and characters sent so far
+
+	TerminalOutput(Chip8* chip8, FILE* out = stdout, double max_fps = TERMINAL_FPS) :
+		chip8(chip8), out(out), max_fps(max_fps) {}
+	// Writes the last frame if it was skipped, then shows the cursor again and leaves it below the frame
+	~TerminalOutput();
+
+	// Draw a framebuffer, unless the last frame went out less than 1/max_fps ago. Then it's kept and written by Flush.
+	void Draw(const uint64_t (*gfx)[GFX_WORDS], bool hires);
+	// Writes a skipped frame once 1/max_fps has passed, call it regularly while nothing new is being drawn so a ROM
+	// that stops drawing (waiting on a key, on a title screen) doesn't leave an old frame up
+	void Flush();
+	// OutputSink, draws the chip8's framebuffer
+	void Present() override { Draw(chip8->gfx, chip8->hires); }
+	void Idle() override { Flush(); }
+
+private:
+	uint64_t shown[HIRES_Y][GFX_WORDS] = {{0}}; // What the terminal has on it
+	bool shown_hires = false;
+	bool started = false; // Set once the screen has been cleared and the first frame drawn
+	bool pending = false; // A frame was skipped and hasn't been written yet, it's kept below
+	uint64_t pending_gfx[HIRES_Y][GFX_WORDS];
+	bool pending_hires = false;
+	std::chrono::steady_clock::time_point last_frame;
+	std::string buf; // Reused for every frame
+
+	void MoveTo(int row, int col);
+	// Whether the next frame can go out
+	bool Due(std::chrono::steady_clock::time_point now) const;
+};
+
+#endif // TERMINAL_H
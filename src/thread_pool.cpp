@@ -0,0 +1,91 @@
+#include <thread_pool.h>
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t num_threads){
+	if (!num_threads)
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+	for (size_t i = 0; i < num_threads; i++)
+		queues.emplace_back(new WorkQueue);
+	for (size_t i = 0; i < num_threads; i++)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool(){
+	{
+		std::lock_guard<std::mutex> guard(idle_lock);
+		stop = true;
+	}
+	work_available.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task){
+	WorkQueue& queue = *queues[next_queue++ % queues.size()];
+	pending++;
+	{
+		std::lock_guard<std::mutex> guard(queue.lock);
+		queue.tasks.push_back(std::move(task));
+	}
+	// Take idle_lock so a worker can't miss the notification between checking for work and going to sleep
+	std::lock_guard<std::mutex> guard(idle_lock);
+	work_available.notify_one();
+}
+
+void ThreadPool::Wait(){
+	std::unique_lock<std::mutex> guard(idle_lock);
+	all_done.wait(guard, [this]{ return pending == 0; });
+}
+
+bool ThreadPool::PopTask(size_t id, std::function<void()>& task){
+	// Own queue first, newest task
+	{
+		WorkQueue& own = *queues[id];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (!own.tasks.empty()){
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+	// Steal the oldest task from someone else
+	for (size_t i = 1; i < queues.size(); i++){
+		WorkQueue& victim = *queues[(id + i) % queues.size()];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.tasks.empty()){
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::WorkerLoop(size_t id){
+	std::function<void()> task;
+	while (true){
+		if (PopTask(id, task)){
+			task();
+			task = nullptr;
+			if (--pending == 0){
+				std::lock_guard<std::mutex> guard(idle_lock);
+				all_done.notify_all();
+			}
+			continue;
+		}
+		std::unique_lock<std::mutex> guard(idle_lock);
+		if (stop)
+			return;
+		// Check the queues again under idle_lock, Submit notifies while holding it so no wakeup gets lost
+		work_available.wait(guard, [this]{
+			if (stop)
+				return true;
+			for (auto& queue : queues){
+				std::lock_guard<std::mutex> queue_guard(queue->lock);
+				if (!queue->tasks.empty())
+					return true;
+			}
+			return false;
+		});
+	}
+}
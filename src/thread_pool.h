@@ -0,0 +1,50 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Work-stealing thread pool
+ * Every worker owns a deque of tasks. Workers take tasks from the back of their own deque and, once it is empty,
+ * steal from the front of the other workers' deques, so a few long running tasks don't leave the other cores idle. */
+class ThreadPool {
+public:
+	// num_threads = 0 uses one worker per hardware thread
+	ThreadPool(size_t num_threads = 0);
+	~ThreadPool();
+
+	// Queue a task, tasks are handed out to workers round robin
+	void Submit(std::function<void()> task);
+	// Block until every submitted task has finished
+	void Wait();
+
+	size_t NumThreads() const { return workers.size(); }
+
+private:
+	struct WorkQueue {
+		std::mutex lock;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	std::atomic<size_t> next_queue{0};
+	std::atomic<size_t> pending{0}; // Tasks submitted but not finished yet
+	std::atomic<bool> stop{false};
+
+	// Sleeping workers wait on this until there is work or the pool shuts down
+	std::mutex idle_lock;
+	std::condition_variable work_available;
+	std::condition_variable all_done;
+
+	void WorkerLoop(size_t id);
+	bool PopTask(size_t id, std::function<void()>& task);
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,92 @@
+#include <trace.h>
+#include <cpu.h>
+#include <chrono>
+#include <cstring>
+
+bool Tracer::Start(const char* path){
+	Stop();
+	file = fopen(path, "wb");
+	if (!file){
+		printf("Could not open trace file \"%s\"\n", path);
+		return false;
+	}
+	uint16_t header[3] = {TRACE_VERSION, TRACE_BYTE_ORDER, sizeof(TraceRecord)};
+	fwrite(TRACE_MAGIC, 1, 4, file);
+	fwrite(header, sizeof(header), 1, file);
+	first = true;
+	running = true;
+	drain = std::thread(&Tracer::Drain, this);
+	return true;
+}
+
+void Tracer::Stop(){
+	if (!running)
+		return;
+	running = false;
+	drain.join();
+	if (fclose(file))
+		printf("Failed to write the trace\n");
+	file = NULL;
+}
+
+void Tracer::Fill(TraceRecord& record, uint8_t type){
+	record.cycle = cpu->cycles;
+	record.ticks = 0;
+	record.pc = cpu->pc;
+	record.opcode = 0;
+	record.i = cpu->i;
+	record.vmask = 0;
+	record.type = type;
+	record.dt = cpu->dt;
+	record.st = cpu->st;
+	record.sp = cpu->sp;
+	memcpy(record.v, cpu->v, NUM_VREGS);
+}
+
+void Tracer::Instruction(uint16_t addr, uint16_t opcode){
+	TraceRecord record;
+	Fill(record, TRACE_INSN);
+	record.pc = addr;
+	record.opcode = opcode;
+	for (int r = 0; r < NUM_VREGS; r++)
+		if (first || record.v[r] != last_v[r])
+			record.vmask |= 1 << r;
+	memcpy(last_v, record.v, NUM_VREGS);
+	first = false;
+	Push(record);
+}
+
+void Tracer::Tick(uint32_t ticks){
+	TraceRecord record;
+	Fill(record, TRACE_TICK);
+	record.ticks = ticks;
+	Push(record);
+}
+
+void Tracer::Push(const TraceRecord& record){
+	if (!running)
+		return;
+	// Never drop records, a trace with holes in it is worse than a slower run
+	while (!ring.Push(record)){
+		stalls++;
+		std::this_thread::yield();
+	}
+	records++;
+}
+
+void Tracer::Drain(){
+	const TraceRecord* data;
+	for (;;){
+		// Check before peeking, so everything pushed before Stop() is written on the last pass
+		bool stopping = !running;
+		size_t n = ring.Peek(&data);
+		if (n){
+			fwrite(data, sizeof(TraceRecord), n, file);
+			ring.Pop(n);
+		} else if (stopping){
+			break;
+		} else {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+}
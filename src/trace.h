@@ -0,0 +1,112 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chip8.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+// Trace files start with this, the format version, a byte order mark and sizeof(TraceRecord)
+#define TRACE_MAGIC "C8TR"
+#define TRACE_VERSION 1
+#define TRACE_BYTE_ORDER 0x0102
+// Records the ring holds, must be a power of two
+#define TRACE_RING_SIZE (1 << 16)
+// Where -v cpu/-v clock trace to when no file is given
+#define DEFAULT_TRACE_PATH "chip8.trace"
+
+class CPU;
+
+enum TraceType : uint8_t {
+	TRACE_INSN, // An instruction ran, the registers are as it left them
+	TRACE_TICK, // A 60Hz clock tick
+};
+
+// Fixed-size trace record, written to the file exactly as it is in memory
+struct TraceRecord {
+	uint64_t cycle; // CPU::cycles when it was recorded
+	uint32_t ticks; // TRACE_TICK: ticks elapsed
+	uint16_t pc; // TRACE_INSN: address of the instruction, otherwise the CPU's pc
+	uint16_t opcode;
+	uint16_t i;
+	uint16_t vmask; // Which V registers the instruction changed, bit n for Vn
+	uint8_t type;
+	uint8_t dt;
+	uint8_t st;
+	uint8_t sp;
+	uint8_t v[NUM_VREGS];
+};
+
+/* Single producer, single consumer ring of TraceRecords
+ * The emulation thread pushes and the drain thread reads whole contiguous runs of records straight out of the buffer.
+ * Neither side ever takes a lock, head and tail are only written by their own side. */
+class TraceRing {
+public:
+	TraceRing() : buf(new TraceRecord[TRACE_RING_SIZE]) {}
+
+	// Producer. False if the ring is full.
+	bool Push(const TraceRecord& record){
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == TRACE_RING_SIZE)
+			return false;
+		buf[h & (TRACE_RING_SIZE - 1)] = record;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+	// Consumer. Points data at the oldest records and returns how many can be read in one go (up to the end of the buffer).
+	size_t Peek(const TraceRecord** data){
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t available = head.load(std::memory_order_acquire) - t;
+		size_t offset = t & (TRACE_RING_SIZE - 1);
+		*data = &buf[offset];
+		return std::min(available, (size_t) TRACE_RING_SIZE - offset);
+	}
+	// Consumer. Frees the first n records returned by Peek.
+	void Pop(size_t n){
+		tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+	}
+
+private:
+	std::unique_ptr<TraceRecord[]> buf;
+	alignas(64) std::atomic<size_t> head{0}; // Next slot to write
+	alignas(64) std::atomic<size_t> tail{0}; // Next slot to read
+};
+
+/* Binary execution trace
+ * The emulation thread only fills in a TraceRecord and pushes it into the ring, a background thread writes the
+ * records out to the file. Decode a trace with chip8-trace. */
+class Tracer {
+public:
+	Tracer(const CPU* cpu) : cpu(cpu) {}
+	~Tracer() { Stop(); }
+
+	// Open the file and start the drain thread
+	bool Start(const char* path);
+	// Write out everything still in the ring and close the file
+	void Stop();
+
+	// Called by CPU::cycle() after the instruction at addr ran
+	void Instruction(uint16_t addr, uint16_t opcode);
+	// Called by Clock::tick()
+	void Tick(uint32_t ticks);
+
+	uint64_t records = 0; // Records pushed
+	uint64_t stalls = 0; // Times the ring was full and the emulation thread had to wait for the drain thread
+
+private:
+	const CPU* cpu;
+	FILE* file = NULL;
+	TraceRing ring;
+	std::thread drain;
+	std::atomic<bool> running{false};
+	uint8_t last_v[NUM_VREGS];
+	bool first = true; // The first instruction record has every register marked as changed
+
+	void Fill(TraceRecord& record, uint8_t type);
+	void Push(const TraceRecord& record);
+	void Drain();
+};
+
+#endif // TRACE_H
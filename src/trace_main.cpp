@@ -0,0 +1,115 @@
+// chip8-trace: turns a binary trace from --trace (or -v cpu/clock) into text, one line per record
+#include <chip8.h>
+#include <trace.h>
+#include <cstring>
+
+// For parsing CLI args
+#include <getopt.h>
+
+void help_menu(){
+	printf("Usage: chip8-trace [options] <trace_file>\n"
+			"Prints each instruction as: cycle, address, opcode, assembly, then the registers it changed.\n"
+			"Options:\n"
+			"-s, --start <cycle>\t\tSkip records before this cycle\n"
+			"-n, --count <n>\t\t\tStop after printing n records\n"
+			"-h, --help\t\t\tThis help menu\n");
+}
+
+// Print the registers that differ from the previous record (or all of them for the first one)
+void print_changes(const TraceRecord& record, const TraceRecord* prev){
+	for (int r = 0; r < NUM_VREGS; r++)
+		if (record.vmask & (1 << r))
+			printf(" V%X=%02X", r, record.v[r]);
+	if (!prev || record.i != prev->i)
+		printf(" I=%03X", record.i);
+	if (!prev || record.dt != prev->dt)
+		printf(" DT=%02X", record.dt);
+	if (!prev || record.st != prev->st)
+		printf(" ST=%02X", record.st);
+	if (!prev || record.sp != prev->sp)
+		printf(" SP=%u", record.sp);
+}
+
+int main(int argc, char *argv[]){
+	uint64_t start_cycle = 0;
+	uint64_t count = UINT64_MAX;
+	int o;
+	int opt_index = 0;
+
+	const struct option long_opts[] =
+	{
+		{"start", required_argument, 0, 's'},
+		{"count", required_argument, 0, 'n'},
+		{"help",   no_argument,  0, 'h'},
+		{0,0,0,0},
+	};
+
+	while ((o = getopt_long(argc, argv, "hs:n:", long_opts, &opt_index)) != -1){
+		switch (o){
+			case 's':
+				start_cycle = std::strtoull(optarg, NULL, 0);
+				break;
+			case 'n':
+				count = std::strtoull(optarg, NULL, 0);
+				break;
+			case 'h':
+				help_menu();
+				exit(0);
+				break;
+			default:
+				help_menu();
+				exit(1);
+				break;
+		}
+	}
+
+	if (optind >= argc){
+		help_menu();
+		exit(1);
+	}
+	const char* path = argv[optind];
+
+	FILE* file = fopen(path, "rb");
+	if (!file){
+		printf("Could not open \"%s\"\n", path);
+		return 1;
+	}
+	char magic[4];
+	uint16_t header[3];
+	if (fread(magic, 1, 4, file) != 4 || memcmp(magic, TRACE_MAGIC, 4) || fread(header, sizeof(header), 1, file) != 1){
+		printf("\"%s\" is not a trace\n", path);
+		return 1;
+	}
+	if (header[0] != TRACE_VERSION || header[1] != TRACE_BYTE_ORDER || header[2] != sizeof(TraceRecord)){
+		printf("\"%s\" is trace version %u from a different build or host, expected version %u\n", path, header[0], TRACE_VERSION);
+		return 1;
+	}
+
+	// Read in chunks, traces of whole sessions don't fit in memory
+	static TraceRecord chunk[4096];
+	TraceRecord prev;
+	bool have_prev = false;
+	uint64_t printed = 0;
+	size_t n;
+	while (printed < count && (n = fread(chunk, sizeof(TraceRecord), 4096, file)) > 0){
+		for (size_t k = 0; k < n && printed < count; k++){
+			const TraceRecord& record = chunk[k];
+			if (record.cycle >= start_cycle){
+				if (record.type == TRACE_INSN){
+					char text[32];
+					Op::disassemble(record.opcode, text, sizeof(text));
+					printf("%10llu  %03X  %04X  %-18s", (unsigned long long) record.cycle, record.pc, record.opcode, text);
+				} else {
+					printf("%10llu  tick %-20u", (unsigned long long) record.cycle, record.ticks);
+				}
+				print_changes(record, have_prev ? &prev : NULL);
+				printf("\n");
+				printed++;
+			}
+			prev = record;
+			have_prev = true;
+		}
+	}
+	fclose(file);
+	return 0;
+}